@@ -0,0 +1,260 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/**
+ * Benchmark driver for posh. It generates a script for each scenario, runs
+ * posh on it with the per-command timing log enabled (posh -t), and
+ * reports the throughput, the latency percentiles, and the peak RSS of the
+ * shell.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "types.h"
+
+#define DEEP_PIPELINE_STAGES	12	/* Keep the tokens within MAX_NR_TOKENS */
+#define NR_HISTORY_SEEDS		100
+
+static const char *posh = "./posh";
+static const char *toy = "./toy";
+static int nr_commands = 1000;
+static unsigned int seed = 0x5eed;
+
+struct scenario {
+	const char *name;
+	void (*generate)(FILE *script, int nr_commands);
+	int nr_warmup;	/* Leading commands that are not measured */
+};
+
+static void __generate_toy(FILE *script, int nr_commands)
+{
+	for (int i = 0; i < nr_commands; i++) {
+		fprintf(script, "%s arg1 arg2 arg3\n", toy);
+	}
+}
+
+static void __generate_pipe(FILE *script, int nr_commands)
+{
+	for (int i = 0; i < nr_commands; i++) {
+		fprintf(script, "echo hello my cruel world | cat\n");
+	}
+}
+
+static void __generate_deep_pipe(FILE *script, int nr_commands)
+{
+	for (int i = 0; i < nr_commands / 10; i++) {
+		fprintf(script, "echo hello");
+		for (int j = 1; j < DEEP_PIPELINE_STAGES; j++) {
+			fprintf(script, " | cat");
+		}
+		fprintf(script, "\n");
+	}
+}
+
+static void __generate_history(FILE *script, int nr_commands)
+{
+	/* Seed the history with builtins, and recall them at random */
+	for (int i = 0; i < NR_HISTORY_SEEDS; i++) {
+		fprintf(script, "cd .\n");
+	}
+	for (int i = 0; i < nr_commands; i++) {
+		fprintf(script, "! %d\n", rand_r(&seed) % NR_HISTORY_SEEDS);
+	}
+}
+
+static void __generate_builtin(FILE *script, int nr_commands)
+{
+	for (int i = 0; i < nr_commands; i++) {
+		fprintf(script, i % 2 ? "cd .\n" : "jobs\n");
+	}
+}
+
+static struct scenario scenarios[] = {
+	{ "toy", __generate_toy },
+	{ "pipe", __generate_pipe },
+	{ "deep-pipe", __generate_deep_pipe },
+	{ "history", __generate_history, NR_HISTORY_SEEDS },
+	{ "builtin", __generate_builtin },
+};
+
+static int __compare_latency(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double __elapsed(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int __run_scenario(struct scenario *sc)
+{
+	char script_path[] = "/tmp/posh-bench-script-XXXXXX";
+	char timing_path[] = "/tmp/posh-bench-timing-XXXXXX";
+	struct timespec start, end;
+	long long *latencies = NULL;
+	int nr_latencies = 0, size = 0;
+	double elapsed;
+	long maxrss = 0;
+	char line[128];
+	FILE *script, *timing;
+	int script_fd, timing_fd;
+	int status;
+	pid_t pid;
+
+	script_fd = mkstemp(script_path);
+	timing_fd = mkstemp(timing_path);
+	if (script_fd < 0 || timing_fd < 0) {
+		fprintf(stderr, "Unable to create temporary files\n");
+		return -1;
+	}
+	close(timing_fd);
+
+	script = fdopen(script_fd, "w");
+	sc->generate(script, nr_commands);
+	fprintf(script, "exit\n");
+	fclose(script);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid = fork();
+	if (pid == 0) {
+		int in = open(script_path, O_RDONLY);
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(in, STDIN_FILENO);
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		execl(posh, posh, "-q", "-t", timing_path, NULL);
+		exit(EXIT_FAILURE);
+	}
+	waitpid(pid, &status, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	timing = fopen(timing_path, "r");
+	while (timing && fgets(line, sizeof(line), timing)) {
+		if (sscanf(line, "# maxrss %ld", &maxrss) == 1) continue;
+
+		if (nr_latencies == size) {
+			size = size ? size * 2 : 1024;
+			latencies = realloc(latencies, sizeof(*latencies) * size);
+		}
+		latencies[nr_latencies++] = atoll(line);
+	}
+	if (timing) fclose(timing);
+
+	unlink(script_path);
+	unlink(timing_path);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) || nr_latencies <= sc->nr_warmup + 1) {
+		fprintf(stderr, "%-10s failed\n", sc->name);
+		free(latencies);
+		return -1;
+	}
+
+	/* Do not count the trailing exit nor the warmup commands */
+	nr_latencies--;
+	elapsed = __elapsed(&start, &end);
+	for (int i = 0; i < sc->nr_warmup; i++) {
+		elapsed -= latencies[i] / 1e9;
+	}
+	nr_latencies -= sc->nr_warmup;
+	memmove(latencies, latencies + sc->nr_warmup, sizeof(*latencies) * nr_latencies);
+
+	qsort(latencies, nr_latencies, sizeof(*latencies), __compare_latency);
+
+	printf("%-10s %8d %12.1f %10.1f %10.1f %12ld\n", sc->name, nr_latencies,
+			nr_latencies / elapsed,
+			latencies[nr_latencies * 50 / 100] / 1e3,
+			latencies[nr_latencies * 99 / 100] / 1e3,
+			maxrss);
+
+	free(latencies);
+	return 0;
+}
+
+static void __print_usage(char * const name)
+{
+	printf("Usage: %s {-n commands} {-s seed} {-p posh} {-t toy} {scenario ...}\n", name);
+	printf("\n");
+	printf("  -n: Number of commands per scenario (default: %d)\n", nr_commands);
+	printf("  -s: Seed for the random history recalls\n");
+	printf("  -p: Path to the shell (default: %s)\n", posh);
+	printf("  -t: Path to the toy program (default: %s)\n", toy);
+	printf("\n");
+	printf("  Scenarios:");
+	for (int i = 0; i < sizeof(scenarios) / sizeof(*scenarios); i++) {
+		printf(" %s", scenarios[i].name);
+	}
+	printf("\n\n");
+}
+
+int main(int argc, char * const argv[])
+{
+	int opt;
+	int ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "n:s:p:t:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_commands = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'p':
+			posh = optarg;
+			break;
+		case 't':
+			toy = optarg;
+			break;
+		case 'h':
+		default:
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (nr_commands < 10) nr_commands = 10;
+
+	printf("%-10s %8s %12s %10s %10s %12s\n",
+			"scenario", "cmds", "cmds/sec", "p50(us)", "p99(us)", "maxrss(KB)");
+
+	for (int i = 0; i < sizeof(scenarios) / sizeof(*scenarios); i++) {
+		bool selected = (optind >= argc);
+
+		for (int j = optind; j < argc; j++) {
+			if (strcmp(argv[j], scenarios[i].name) == 0) selected = true;
+		}
+		if (!selected) continue;
+
+		if (__run_scenario(scenarios + i)) ret = EXIT_FAILURE;
+	}
+
+	return ret;
+}
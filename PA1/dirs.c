@@ -0,0 +1,239 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "dirs.h"
+
+/**
+ * A directory held open. @path is what getcwd() returned when we changed
+ * into it, which is used for printing and $PWD.
+ */
+struct dir {
+	int fd;
+	char *path;
+};
+
+static struct dir *stack = NULL;	/* stack[nr_dirs - 1] is the current one */
+static int nr_dirs = 0;
+static int stack_size = 0;
+
+static struct dir oldpwd = { -1, NULL };
+
+static void __release_dir(struct dir *dir)
+{
+	if (dir->fd >= 0) close(dir->fd);
+	free(dir->path);
+	dir->fd = -1;
+	dir->path = NULL;
+}
+
+static inline struct dir *__current(void)
+{
+	return stack + nr_dirs - 1;
+}
+
+static void __update_env(void)
+{
+	if (nr_dirs) setenv("PWD", __current()->path, 1);
+	if (oldpwd.path) setenv("OLDPWD", oldpwd.path, 1);
+}
+
+/* Go back to the current directory after failing to change into another */
+static void __restore_cwd(void)
+{
+	if (nr_dirs) fchdir(__current()->fd);
+}
+
+/* Make a copy of @dir, which we are leaving, the previous directory */
+static void __leave_dir(const struct dir *dir)
+{
+	__release_dir(&oldpwd);
+
+	oldpwd.fd = fcntl(dir->fd, F_DUPFD_CLOEXEC, 0);
+	oldpwd.path = strdup(dir->path);
+	if (oldpwd.fd < 0 || !oldpwd.path) __release_dir(&oldpwd);
+}
+
+/**
+ * Open @path and change into it. Fill @dir on success.
+ */
+static int __open_dir(const char *path, struct dir *dir)
+{
+	char cwd[PATH_MAX];
+
+	dir->fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (dir->fd < 0) return -errno;
+
+	if (fchdir(dir->fd) < 0 || !getcwd(cwd, sizeof(cwd))) {
+		int ret = -errno;
+		close(dir->fd);
+		dir->fd = -1;
+		return ret;
+	}
+
+	dir->path = strdup(cwd);
+	if (!dir->path) {
+		close(dir->fd);
+		dir->fd = -1;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+int change_dir(const char *path)
+{
+	struct dir dir;
+	int ret;
+
+	if (!path || strcmp(path, "~") == 0) {
+		path = getenv("HOME");
+		if (!path) return -ENOENT;
+	}
+
+	if (strcmp(path, "-") == 0) {
+		if (oldpwd.fd < 0) return -ENOENT;
+		if (fchdir(oldpwd.fd) < 0) return -errno;
+
+		/* Swap the current and the previous directories */
+		dir = oldpwd;
+		oldpwd = *__current();
+		*__current() = dir;
+
+		fprintf(stderr, "%s\n", dir.path);
+		__update_env();
+		return 0;
+	}
+
+	ret = __open_dir(path, &dir);
+	if (ret) {
+		/* Stay in the current directory */
+		__restore_cwd();
+		return ret;
+	}
+
+	/* We were nowhere if the stack is empty. Just be here then */
+	if (!nr_dirs) {
+		stack[nr_dirs++] = dir;
+		__update_env();
+		return 0;
+	}
+
+	__release_dir(&oldpwd);
+	oldpwd = *__current();
+	*__current() = dir;
+
+	__update_env();
+	return 0;
+}
+
+int push_dir(const char *path)
+{
+	struct dir dir;
+	int ret;
+
+	if (!path) {
+		if (nr_dirs < 2) return -ENOENT;
+		if (fchdir(stack[nr_dirs - 2].fd) < 0) return -errno;
+
+		dir = stack[nr_dirs - 2];
+		stack[nr_dirs - 2] = stack[nr_dirs - 1];
+		stack[nr_dirs - 1] = dir;
+		__leave_dir(stack + nr_dirs - 2);
+		goto out;
+	}
+
+	if (nr_dirs == stack_size) {
+		int size = stack_size * 2;
+		struct dir *s = realloc(stack, sizeof(*s) * size);
+
+		if (!s) return -ENOMEM;
+		stack = s;
+		stack_size = size;
+	}
+
+	ret = __open_dir(path, &dir);
+	if (ret) {
+		__restore_cwd();
+		return ret;
+	}
+	if (nr_dirs) __leave_dir(__current());
+	stack[nr_dirs++] = dir;
+
+out:
+	dump_dirs();
+	__update_env();
+	return 0;
+}
+
+int pop_dir(void)
+{
+	if (nr_dirs < 2) return -ENOENT;
+	if (fchdir(stack[nr_dirs - 2].fd) < 0) return -errno;
+
+	/* The popped one is where we were */
+	__release_dir(&oldpwd);
+	oldpwd = *__current();
+	nr_dirs--;
+
+	dump_dirs();
+	__update_env();
+	return 0;
+}
+
+void dump_dirs(void)
+{
+	for (int i = nr_dirs - 1; i >= 0; i--) {
+		fprintf(stderr, "%s%s", stack[i].path, i ? " " : "\n");
+	}
+}
+
+int initialize_dirs(void)
+{
+	stack_size = 8;
+	stack = malloc(sizeof(*stack) * stack_size);
+	if (!stack) return -ENOMEM;
+
+	/**
+	 * The shell may be started in a directory that it cannot open or that
+	 * is removed. Start with the empty stack then; cd, pushd, and popd work
+	 * once it changes into a directory
+	 */
+	if (__open_dir(".", stack)) {
+		fprintf(stderr, "Unable to open the current directory. The directory stack is empty\n");
+		return 0;
+	}
+	nr_dirs = 1;
+	return 0;
+}
+
+void finalize_dirs(void)
+{
+	for (int i = 0; i < nr_dirs; i++) {
+		__release_dir(stack + i);
+	}
+	__release_dir(&oldpwd);
+
+	free(stack);
+	stack = NULL;
+	nr_dirs = stack_size = 0;
+}
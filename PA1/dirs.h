@@ -0,0 +1,71 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __DIRS_H__
+#define __DIRS_H__
+
+/***********************************************************************
+ * change_dir()
+ *
+ * DESCRIPTION
+ *  Implement the "cd" built-in command. Change the current directory to
+ *  @path. When @path is NULL or "~", change to $HOME. When @path is "-",
+ *  change back to the previous directory and print it out.
+ *
+ *  The current and the previous directories are held open, so "cd -"
+ *  switches with fchdir(2) without resolving the path again.
+ *
+ * RETURN VALUE
+ *  Return 0 on success, and <0 on error.
+ */
+int change_dir(const char *path);
+
+
+/***********************************************************************
+ * push_dir() / pop_dir() / dump_dirs()
+ *
+ * DESCRIPTION
+ *  Implement the "pushd", "popd", and "dirs" built-in commands on the
+ *  directory stack. The top of the stack is always the current directory.
+ *
+ *  push_dir() changes to @path and pushes it onto the stack. When @path is
+ *  NULL, it exchanges the top two directories. pop_dir() removes the top
+ *  and changes to the new top. dump_dirs() prints out the stack from the
+ *  top to the bottom in a line.
+ *
+ *  Each directory on the stack is held open with O_PATH, so switching
+ *  between them costs a single fchdir(2) regardless of the path depth.
+ *
+ * RETURN VALUE
+ *  push_dir() and pop_dir() return 0 on success, and <0 on error.
+ */
+int push_dir(const char *path);
+int pop_dir(void);
+void dump_dirs(void);
+
+
+/***********************************************************************
+ * initialize_dirs() / finalize_dirs()
+ *
+ * DESCRIPTION
+ *  Set up and tear down the directory stack.
+ *
+ * RETURN VALUE
+ *  initialize_dirs() returns 0 on success, and <0 on error.
+ */
+int initialize_dirs(void);
+void finalize_dirs(void);
+
+#endif
@@ -0,0 +1,446 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fnmatch.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "expand.h"
+
+/**
+ * NULL-terminated, growable array of strings
+ */
+struct strvec {
+	int nr;
+	int size;
+	char **v;
+};
+
+static bool __strvec_push(struct strvec *sv, char *str)
+{
+	if (!str) return false;
+
+	/* Keep one more slot for the terminating NULL */
+	if (sv->nr + 1 >= sv->size) {
+		int size = sv->size ? sv->size * 2 : 16;
+		char **v = realloc(sv->v, sizeof(*v) * size);
+
+		if (!v) {
+			free(str);
+			return false;
+		}
+		sv->v = v;
+		sv->size = size;
+	}
+
+	sv->v[sv->nr++] = str;
+	sv->v[sv->nr] = NULL;
+	return true;
+}
+
+static void __strvec_clear(struct strvec *sv)
+{
+	for (int i = 0; i < sv->nr; i++) {
+		free(sv->v[i]);
+	}
+	free(sv->v);
+	sv->nr = sv->size = 0;
+	sv->v = NULL;
+}
+
+static int __compare_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+
+/***********************************************************************
+ * Directory listing cache
+ *
+ * A directory is identified by its device and inode numbers so that the
+ * same directory reached through different (relative) paths shares one
+ * entry. A cached listing is valid as long as the modification time of
+ * the directory is not changed.
+ */
+struct dirent_name {
+	char *name;
+	size_t offset;			/* Offset of @name in @pool while loading */
+	unsigned char type;		/* d_type from readdir() */
+};
+
+struct dircache {
+	struct list_head list;	/* LRU list. The most recently used comes first */
+
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+
+	bool racy;				/* The directory was modified too recently to
+							   trust @mtime. Reload it on next use */
+
+	int nr_names;
+	struct dirent_name *names;	/* Sorted by name */
+	char *pool;				/* Holds all names back to back */
+};
+
+static LIST_HEAD(dircache);
+static int nr_dircache = 0;
+
+static void __free_dircache(struct dircache *dc)
+{
+	list_del(&dc->list);
+	nr_dircache--;
+
+	free(dc->names);
+	free(dc->pool);
+	free(dc);
+}
+
+static int __compare_dirent_name(const void *a, const void *b)
+{
+	return strcmp(((const struct dirent_name *)a)->name,
+			((const struct dirent_name *)b)->name);
+}
+
+static struct dircache *__load_dircache(const char *path, struct stat *st)
+{
+	struct dircache *dc;
+	struct dirent *de;
+	struct timespec now;
+	size_t pool_size = 4096, pool_used = 0;
+	int names_size = 64;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir) return NULL;
+
+	dc = malloc(sizeof(*dc));
+	if (!dc) goto out_close;
+	memset(dc, 0x00, sizeof(*dc));
+
+	dc->names = malloc(sizeof(*dc->names) * names_size);
+	dc->pool = malloc(pool_size);
+	if (!dc->names || !dc->pool) goto out_free;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	while ((de = readdir(dir))) {
+		size_t len = strlen(de->d_name) + 1;
+
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+
+		if (dc->nr_names == names_size) {
+			struct dirent_name *names;
+
+			names_size *= 2;
+			names = realloc(dc->names, sizeof(*names) * names_size);
+			if (!names) goto out_free;
+			dc->names = names;
+		}
+		if (pool_used + len > pool_size) {
+			char *pool;
+
+			while (pool_used + len > pool_size) pool_size *= 2;
+			pool = realloc(dc->pool, pool_size);
+			if (!pool) goto out_free;
+			dc->pool = pool;
+		}
+
+		memcpy(dc->pool + pool_used, de->d_name, len);
+		dc->names[dc->nr_names].offset = pool_used;
+		dc->names[dc->nr_names].type = de->d_type;
+		dc->nr_names++;
+		pool_used += len;
+	}
+	closedir(dir);
+
+	/* @pool does not move any more. Resolve the names and sort them */
+	for (int i = 0; i < dc->nr_names; i++) {
+		dc->names[i].name = dc->pool + dc->names[i].offset;
+	}
+	qsort(dc->names, dc->nr_names, sizeof(*dc->names), __compare_dirent_name);
+
+	dc->dev = st->st_dev;
+	dc->ino = st->st_ino;
+	dc->mtime = st->st_mtim;
+
+	/**
+	 * File systems keep timestamps at a coarse granularity. If the directory
+	 * was modified within a second from now, another modification may come
+	 * without changing @mtime. Do not trust such a listing.
+	 */
+	dc->racy = (dc->mtime.tv_sec + 1 >= now.tv_sec);
+
+	return dc;
+
+out_free:
+	free(dc->names);
+	free(dc->pool);
+	free(dc);
+out_close:
+	closedir(dir);
+	return NULL;
+}
+
+static struct dircache *__get_dircache(const char *path)
+{
+	struct dircache *dc;
+	struct stat st;
+
+	if (stat(path, &st) || !S_ISDIR(st.st_mode)) return NULL;
+
+	list_for_each_entry(dc, &dircache, list) {
+		if (dc->dev != st.st_dev || dc->ino != st.st_ino) continue;
+
+		if (!dc->racy &&
+				dc->mtime.tv_sec == st.st_mtim.tv_sec &&
+				dc->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			list_move(&dc->list, &dircache);
+			return dc;
+		}
+
+		/* Stale. Reload it */
+		__free_dircache(dc);
+		break;
+	}
+
+	dc = __load_dircache(path, &st);
+	if (!dc) return NULL;
+
+	list_add(&dc->list, &dircache);
+	nr_dircache++;
+
+	if (nr_dircache > MAX_DIRCACHE_ENTRIES) {
+		__free_dircache(list_last_entry(&dircache, struct dircache, list));
+	}
+
+	return dc;
+}
+
+void flush_dircache(void)
+{
+	struct dircache *dc, *tmp;
+
+	list_for_each_entry_safe(dc, tmp, &dircache, list) {
+		__free_dircache(dc);
+	}
+}
+
+
+/***********************************************************************
+ * Glob expansion
+ */
+static inline bool __has_magic(const char *str, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (str[i] == '*' || str[i] == '?' || str[i] == '[') return true;
+	}
+	return false;
+}
+
+static char *__join_path(const char *prefix, const char *name, size_t len, bool slash)
+{
+	size_t prefix_len = strlen(prefix);
+	char *path = malloc(prefix_len + len + 2);
+
+	if (!path) return NULL;
+
+	memcpy(path, prefix, prefix_len);
+	memcpy(path + prefix_len, name, len);
+	if (slash) path[prefix_len + len++] = '/';
+	path[prefix_len + len] = '\0';
+
+	return path;
+}
+
+static bool __is_dir(const char *prefix, const struct dirent_name *dn)
+{
+	struct stat st;
+	char *path;
+	bool is_dir;
+
+	if (dn->type == DT_DIR) return true;
+	if (dn->type != DT_UNKNOWN && dn->type != DT_LNK) return false;
+
+	path = __join_path(prefix, dn->name, strlen(dn->name), false);
+	if (!path) return false;
+	is_dir = (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+	free(path);
+
+	return is_dir;
+}
+
+/**
+ * Find the first name in @dc that is not smaller than @prefix. As the names
+ * are sorted, all the names starting with @prefix follow it consecutively.
+ */
+static int __lower_bound(struct dircache *dc, const char *prefix, size_t len)
+{
+	int lo = 0, hi = dc->nr_names;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (strncmp(dc->names[mid].name, prefix, len) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Expand @pattern and append the matches to @out. Return the number of
+ * matches, or -ENOMEM on allocation failure.
+ */
+static int __expand_pattern(const char *pattern, struct strvec *out)
+{
+	struct strvec curr = { 0 }, next = { 0 };
+	const char *p = pattern;
+	bool magic_seen = false;
+	bool need_check = false;
+	int nr_matches = 0;
+
+	if (!__strvec_push(&curr, strdup(*p == '/' ? "/" : ""))) goto out_nomem;
+	while (*p == '/') p++;
+
+	while (*p && curr.nr) {
+		const char *end = strchr(p, '/');
+		size_t len = end ? end - p : strlen(p);
+		bool slash = (end != NULL);
+		bool magic = __has_magic(p, len);
+		size_t literal_len;
+		char component[len + 1];
+
+		memcpy(component, p, len);
+		component[len] = '\0';
+		literal_len = strcspn(component, "*?[\\");
+
+		for (int i = 0; i < curr.nr; i++) {
+			const char *prefix = curr.v[i];
+			struct dircache *dc;
+
+			if (!magic) {
+				if (!__strvec_push(&next, __join_path(prefix, p, len, slash)))
+					goto out_nomem;
+				continue;
+			}
+
+			dc = __get_dircache(prefix[0] ? prefix : ".");
+			if (!dc) continue;
+
+			/* Only the names sharing the literal prefix can match */
+			for (int j = __lower_bound(dc, component, literal_len);
+					j < dc->nr_names; j++) {
+				struct dirent_name *dn = dc->names + j;
+
+				if (strncmp(dn->name, component, literal_len)) break;
+				if (fnmatch(component, dn->name, FNM_PERIOD)) continue;
+				if (slash && !__is_dir(prefix, dn)) continue;
+
+				if (!__strvec_push(&next,
+						__join_path(prefix, dn->name, strlen(dn->name), slash)))
+					goto out_nomem;
+			}
+		}
+
+		if (magic_seen && !magic) need_check = true;
+		magic_seen |= magic;
+
+		__strvec_clear(&curr);
+		curr = next;
+		memset(&next, 0x00, sizeof(next));
+
+		p += len;
+		while (*p == '/') p++;
+	}
+
+	/* Sort the matches as a whole */
+	qsort(curr.v, curr.nr, sizeof(*curr.v), __compare_str);
+
+	for (int i = 0; i < curr.nr; i++) {
+		struct stat st;
+
+		/* Literal components after a pattern are not verified yet */
+		if (need_check && lstat(curr.v[i], &st)) continue;
+
+		if (!__strvec_push(out, curr.v[i])) {
+			curr.v[i] = NULL;
+			goto out_nomem;
+		}
+		curr.v[i] = NULL;
+		nr_matches++;
+	}
+	__strvec_clear(&curr);
+
+	return nr_matches;
+
+out_nomem:
+	__strvec_clear(&curr);
+	__strvec_clear(&next);
+	return -ENOMEM;
+}
+
+char **expand_tokens(int nr_tokens, char * const tokens[], int *nr_expanded)
+{
+	struct strvec sv = { 0 };
+
+	for (int i = 0; i < nr_tokens; i++) {
+		int nr_matches = 0;
+
+		if (__has_magic(tokens[i], strlen(tokens[i]))) {
+			nr_matches = __expand_pattern(tokens[i], &sv);
+			if (nr_matches < 0) goto out_nomem;
+		}
+
+		/* No magic or no match. Keep the token as it is */
+		if (nr_matches == 0 && !__strvec_push(&sv, strdup(tokens[i])))
+			goto out_nomem;
+	}
+
+	if (!sv.v) {
+		sv.v = malloc(sizeof(*sv.v));
+		if (!sv.v) return NULL;
+		sv.v[0] = NULL;
+	}
+
+	*nr_expanded = sv.nr;
+	return sv.v;
+
+out_nomem:
+	__strvec_clear(&sv);
+	return NULL;
+}
+
+void free_tokens(char **tokens)
+{
+	if (!tokens) return;
+
+	for (char **t = tokens; *t; t++) {
+		free(*t);
+	}
+	free(tokens);
+}
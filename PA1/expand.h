@@ -0,0 +1,70 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __EXPAND_H__
+#define __EXPAND_H__
+
+#define MAX_DIRCACHE_ENTRIES	16	/* Maximum number of cached directories */
+
+
+/***********************************************************************
+ * expand_tokens()
+ *
+ * DESCRIPTION
+ *  Expand glob patterns in @tokens[] into the list of matching path names.
+ *  A token is a pattern if it contains any of '*', '?', or '['. Patterns
+ *  are matched component by component with fnmatch(3), so a pattern with
+ *  slashes such as "spool?/[0-9]?.log" works as expected. Files starting
+ *  with '.' are matched only when the pattern component starts with '.'.
+ *
+ *  Matches are sorted in the byte order. A pattern that does not match
+ *  anything is passed through as it is.
+ *
+ *  For example, when the current directory has a.log, b.log, and c.txt,
+ *   tokens = { "ls", "-l", "*.log", NULL }
+ *
+ *  then, *nr_expanded = 4, and the returned array is
+ *   { "ls", "-l", "a.log", "b.log", NULL }
+ *
+ *  Directory listings are kept in a small LRU cache that is validated by
+ *  the modification time of the directory, so expanding the same pattern
+ *  over and over does not re-read the directory unless it is changed.
+ *
+ * RETURN VALUE
+ *  Return a NULL-terminated array of newly allocated tokens. Release it
+ *  with free_tokens().
+ *  Return NULL on memory allocation failure.
+ */
+char **expand_tokens(int nr_tokens, char * const tokens[], int *nr_expanded);
+
+
+/***********************************************************************
+ * free_tokens()
+ *
+ * DESCRIPTION
+ *  Release @tokens returned from expand_tokens().
+ */
+void free_tokens(char **tokens);
+
+
+/***********************************************************************
+ * flush_dircache()
+ *
+ * DESCRIPTION
+ *  Drop all the cached directory listings.
+ */
+void flush_dircache(void);
+
+#endif
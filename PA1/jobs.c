@@ -0,0 +1,1448 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "jobs.h"
+
+enum job_state {
+	JOB_QUEUED,		/* Waiting for admission */
+	JOB_RUNNING,	/* Processes are spawned and some are still alive */
+	JOB_DONE,		/* All processes are collected */
+	JOB_STOPPED,	/* Stopped by a signal, e.g., Ctrl-Z */
+};
+
+static const char *__job_state_sz[] = {
+	"Queued",
+	"Running",
+	"Done",
+	"Stopped",
+};
+
+struct job;
+
+/**
+ * Output stream of a background job, which is collected by the shell and
+ * emitted line by line with the job ID prefixed
+ */
+struct job_output {
+	struct job *job;
+	int fd;					/* Read end of the pipe. Non-blocking */
+	int target;				/* Where to emit the lines to */
+	size_t len;				/* # of bytes of a partial line in @buffer */
+	char buffer[MAX_OUTPUT_LINE];
+};
+
+struct job {
+	struct list_head list;	/* In @jobs when admitted, @job_queue otherwise */
+
+	int id;
+	bool background;
+	bool throttled;			/* Counted in @nr_running */
+	enum job_state state;
+	pid_t pgid;				/* Process group of the pipeline */
+	struct termios tmodes;	/* Terminal modes when the job is stopped */
+	bool tmodes_saved;
+
+	char **argv;			/* Copy of the tokens. The "|" tokens are replaced
+							   with NULL to terminate each command */
+	int nr_commands;
+	pid_t *pids;			/* PIDs of the commands in the pipeline */
+	int nr_alive;			/* # of processes not collected yet */
+	int status;				/* Exit status of the last command */
+
+	struct job_output *outputs[2];
+							/* Collected stdout and stderr, if tagged */
+	int nr_outputs;			/* # of outputs not closed yet */
+
+	int (*redirs)[2];		/* Per-command stdin and stdout to redirect from/to.
+							   -1 if not redirected. Closed after spawning */
+
+	char *coproc;			/* Name of the coprocess. NULL for regular jobs */
+	int coproc_fds[2];		/* The shell's ends of the pipes to the stdin and
+							   from the stdout of the coprocess */
+	bool notified;			/* Completion is reported. Exited coprocesses are
+							   kept until replaced so that their remaining
+							   outputs can be read */
+
+	char **paths;			/* Pre-resolved executables of the commands for
+							   prepared jobs. NULL to look up $PATH on exec */
+
+	char *command;			/* Command line for the notifications */
+};
+
+static LIST_HEAD(jobs);
+static LIST_HEAD(job_queue);
+
+static int nr_running = 0;	/* # of throttled jobs in JOB_RUNNING */
+static int job_limit = JOB_LIMIT_AUTO;
+static bool job_notify = true;
+static bool job_tagging = false;
+
+/**
+ * Self-pipe to turn SIGCHLD into a readable event, and the epoll instance
+ * watching it along with the outputs of the tagged jobs
+ */
+static int sigchld_pipe[2] = { -1, -1 };
+static int job_epfd = -1;
+static FILE *heredoc_input = NULL;	/* Where to read here-documents from */
+
+/* Here-documents read ahead for the command line being run. See use_heredocs() */
+static struct heredocs *heredocs_in_use = NULL;
+
+/**
+ * Job control is enabled when the shell runs on a terminal. Each job is put
+ * into its own process group then, and the foreground job is given the
+ * terminal so that the signals from the keyboard are delivered to it but
+ * not to the shell.
+ */
+static bool job_control = false;
+static pid_t shell_pgid;
+static struct termios shell_tmodes;
+static volatile sig_atomic_t interrupted = 0;	/* SIGINT while the shell waits */
+
+
+/***********************************************************************
+ * Job allocation
+ */
+static inline bool __is_throttled(struct job *job)
+{
+	/* Coprocesses are long-lived. Do not let them hold the slots */
+	return job->background && !job->coproc;
+}
+
+static void __close_redirections(struct job *job)
+{
+	if (!job->redirs) return;
+
+	for (int i = 0; i < job->nr_commands; i++) {
+		for (int j = 0; j < 2; j++) {
+			if (job->redirs[i][j] >= 0) close(job->redirs[i][j]);
+			job->redirs[i][j] = -1;
+		}
+	}
+}
+
+static void __free_job(struct job *job)
+{
+	list_del(&job->list);
+
+	__close_redirections(job);
+	for (int i = 0; i < 2; i++) {
+		if (job->coproc_fds[i] >= 0) close(job->coproc_fds[i]);
+	}
+
+	if (job->paths) {
+		for (int i = 0; i < job->nr_commands; i++) {
+			free(job->paths[i]);
+		}
+		free(job->paths);
+	}
+	free(job->argv);
+	free(job->pids);
+	free(job->redirs);
+	free(job->coproc);
+	free(job->command);
+	free(job);
+}
+
+/**
+ * Find the coprocess named @name, or the most recent one if @name is NULL
+ */
+static struct job *__find_coproc(const char *name)
+{
+	struct job *job, *found = NULL;
+
+	list_for_each_entry(job, &jobs, list) {
+		if (!job->coproc) continue;
+		if (name && strcmp(job->coproc, name)) continue;
+		if (!found || job->id > found->id) found = job;
+	}
+	return found;
+}
+
+/**
+ * Return a read-only file descriptor that yields @body[0..@len). The body is
+ * put in an anonymous memory file, so nothing hits the file system. Fall back
+ * to a pipe when memfd is not available; the body should fit in the pipe
+ * buffer then since nobody reads the pipe until the command is spawned.
+ */
+static int __open_heredoc(const char *body, size_t len)
+{
+	int fds[2];
+	size_t written = 0;
+
+	fds[0] = memfd_create("posh-heredoc", MFD_CLOEXEC);
+	if (fds[0] >= 0) {
+		while (written < len) {
+			ssize_t ret = write(fds[0], body + written, len - written);
+			if (ret < 0) {
+				if (errno == EINTR) continue;
+				close(fds[0]);
+				return -errno;
+			}
+			written += ret;
+		}
+		lseek(fds[0], 0, SEEK_SET);
+		return fds[0];
+	}
+
+	if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) return -errno;
+	while (written < len) {
+		ssize_t ret = write(fds[1], body + written, len - written);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			close(fds[0]);
+			close(fds[1]);
+			return errno == EAGAIN ? -EFBIG : -errno;
+		}
+		written += ret;
+	}
+	close(fds[1]);
+
+	/* The reader expects a blocking stdin */
+	fcntl(fds[0], F_SETFL, 0);
+	return fds[0];
+}
+
+/**
+ * Read the lines of a here-document from @heredoc_input up to the line
+ * consisting of @delim. Leading tabs are stripped when @strip_tabs is set.
+ * Return the file descriptor holding the body, or <0 on error.
+ */
+static int __read_heredoc(const char *delim, bool strip_tabs)
+{
+	char *line = NULL, *body = NULL;
+	size_t line_size = 0, size = 0, len = 0;
+	size_t delim_len = strlen(delim);
+	ssize_t l;
+	int fd;
+
+	while ((l = getline(&line, &line_size, heredoc_input)) >= 0) {
+		char *p = line;
+
+		if (strip_tabs) {
+			while (*p == '\t') p++, l--;
+		}
+
+		if ((size_t)l >= delim_len && strncmp(p, delim, delim_len) == 0 &&
+				(p[delim_len] == '\n' || p[delim_len] == '\0')) break;
+
+		if (len + l > size) {
+			char *b;
+
+			size = size ? size * 2 : 4096;
+			while (len + l > size) size *= 2;
+
+			b = realloc(body, size);
+			if (!b) {
+				free(body);
+				free(line);
+				return -ENOMEM;
+			}
+			body = b;
+		}
+		memcpy(body + len, p, l);
+		len += l;
+	}
+	free(line);
+
+	fd = __open_heredoc(body, len);
+	free(body);
+
+	return fd;
+}
+
+/**
+ * Take @tokens[*index] as a redirection for the @cmd-th command of @job.
+ *   <<DELIM, <<-DELIM : Read stdin from the here-document
+ *   <<<WORD           : Read stdin from the here-string
+ *   >&p, >&p:NAME     : Write stdout to the most recent/NAME coprocess
+ *   <&p, <&p:NAME     : Read stdin from the most recent/NAME coprocess
+ *
+ * Return 1 if the token is a redirection, 0 if it is an ordinary token,
+ * and <0 on error.
+ */
+static int __parse_redirection(struct job *job, int cmd, char * const tokens[], int *index)
+{
+	const char *token = tokens[*index];
+	int fd = -1;
+
+	if (strncmp(token, "<<<", 3) == 0) {
+		/* Here-string. The word may be attached or be the next token */
+		const char *word = token + 3;
+		size_t len;
+		char *body;
+
+		if (!*word) {
+			if (!tokens[*index + 1]) return -EINVAL;
+			word = tokens[++(*index)];
+		}
+
+		len = strlen(word);
+		body = malloc(len + 1);
+		if (!body) return -ENOMEM;
+		memcpy(body, word, len);
+		body[len] = '\n';
+
+		fd = __open_heredoc(body, len + 1);
+		free(body);
+
+	} else if (strncmp(token, "<<", 2) == 0) {
+		/* Here-document. <<-DELIM strips the leading tabs of the lines */
+		bool strip_tabs = (token[2] == '-');
+		const char *delim = token + (strip_tabs ? 3 : 2);
+
+		if (!*delim) {
+			if (!tokens[*index + 1]) return -EINVAL;
+			delim = tokens[++(*index)];
+		}
+
+		if (heredocs_in_use && heredocs_in_use->next < heredocs_in_use->end) {
+			fd = heredocs_in_use->fds[heredocs_in_use->next];
+			heredocs_in_use->fds[heredocs_in_use->next++] = -1;
+		} else {
+			fd = __read_heredoc(delim, strip_tabs);
+		}
+	}
+
+	if (fd != -1) {
+		if (fd < 0) return fd;
+
+		if (job->redirs[cmd][0] >= 0) close(job->redirs[cmd][0]);
+		job->redirs[cmd][0] = fd;
+		return 1;
+	}
+
+	if ((token[0] == '>' || token[0] == '<') && strncmp(token + 1, "&p", 2) == 0 &&
+			(token[3] == '\0' || token[3] == ':')) {
+		bool input = (token[0] == '<');
+		struct job *coproc = __find_coproc(token[3] ? token + 4 : NULL);
+		int fd;
+
+		if (!coproc || coproc->coproc_fds[input ? 1 : 0] < 0) return -ENOENT;
+
+		fd = fcntl(coproc->coproc_fds[input ? 1 : 0], F_DUPFD_CLOEXEC, 0);
+		if (fd < 0) return -errno;
+
+		if (job->redirs[cmd][input ? 0 : 1] >= 0) close(job->redirs[cmd][input ? 0 : 1]);
+		job->redirs[cmd][input ? 0 : 1] = fd;
+		return 1;
+	}
+
+	return 0;
+}
+
+int read_heredocs(struct heredocs *heredocs, int nr_tokens, char * const tokens[])
+{
+	int nr_read = 0;
+
+	for (int i = 0; i < nr_tokens; i++) {
+		const char *token = tokens[i];
+		bool strip_tabs;
+		const char *delim;
+		int fd;
+
+		if (strncmp(token, "<<", 2) != 0 || token[2] == '<') continue;
+
+		/* Same as __parse_redirection() */
+		strip_tabs = (token[2] == '-');
+		delim = token + (strip_tabs ? 3 : 2);
+		if (!*delim) {
+			if (i + 1 >= nr_tokens) break;
+			delim = tokens[++i];
+		}
+
+		if (heredocs->nr_fds == MAX_HEREDOCS) return -E2BIG;
+
+		fd = __read_heredoc(delim, strip_tabs);
+		if (fd < 0) return fd;
+
+		heredocs->fds[heredocs->nr_fds++] = fd;
+		nr_read++;
+	}
+	return nr_read;
+}
+
+struct heredocs *use_heredocs(struct heredocs *next)
+{
+	struct heredocs *prev = heredocs_in_use;
+
+	heredocs_in_use = next;
+	return prev;
+}
+
+void take_heredocs(struct heredocs *heredocs, int first, int nr)
+{
+	heredocs->next = first;
+	heredocs->end = first + nr;
+}
+
+void drop_heredocs(struct heredocs *heredocs)
+{
+	for (int i = 0; i < heredocs->nr_fds; i++) {
+		if (heredocs->fds[i] >= 0) close(heredocs->fds[i]);
+		heredocs->fds[i] = -1;
+	}
+	heredocs->nr_fds = heredocs->next = heredocs->end = 0;
+}
+
+static int __alloc_job(int nr_tokens, char * const tokens[], bool background, struct job **pjob)
+{
+	struct job *job;
+	size_t len = 0;
+	char *pool, *cmd;
+	int nr_args = 0;
+	int ret;
+
+	job = malloc(sizeof(*job));
+	if (!job) return -ENOMEM;
+	memset(job, 0x00, sizeof(*job));
+	INIT_LIST_HEAD(&job->list);
+	job->coproc_fds[0] = job->coproc_fds[1] = -1;
+
+	job->background = background;
+	job->nr_commands = 1;
+
+	for (int i = 0; i < nr_tokens; i++) {
+		len += strlen(tokens[i]) + 1;
+		if (strcmp(tokens[i], "|") == 0) job->nr_commands++;
+	}
+
+	/**
+	 * Put the token pointers and strings in one chunk, and the command line
+	 * separately.
+	 */
+	job->argv = malloc(sizeof(char *) * (nr_tokens + 1) + len);
+	job->command = malloc(len + 1);
+	job->pids = malloc(sizeof(pid_t) * job->nr_commands);
+	job->redirs = malloc(sizeof(*job->redirs) * job->nr_commands);
+	if (!job->argv || !job->command || !job->pids || !job->redirs) {
+		free(job->redirs);
+		job->redirs = NULL;
+		__free_job(job);
+		return -ENOMEM;
+	}
+	memset(job->pids, 0x00, sizeof(pid_t) * job->nr_commands);
+	memset(job->redirs, 0xff, sizeof(*job->redirs) * job->nr_commands);
+
+	pool = (char *)(job->argv + nr_tokens + 1);
+	cmd = job->command;
+	for (int i = 0, c = 0; i < nr_tokens; i++) {
+		size_t l = strlen(tokens[i]);
+
+		memcpy(cmd, tokens[i], l);
+		cmd += l;
+		*cmd++ = ' ';
+
+		if (strcmp(tokens[i], "|") == 0) {
+			job->argv[nr_args++] = NULL;
+			c++;
+			continue;
+		}
+
+		ret = __parse_redirection(job, c, tokens, &i);
+		if (ret < 0) {
+			__free_job(job);
+			return ret;
+		}
+		if (ret > 0) continue;
+
+		memcpy(pool, tokens[i], l + 1);
+		job->argv[nr_args++] = pool;
+		pool += l + 1;
+	}
+	job->argv[nr_args] = NULL;
+	*(cmd > job->command ? cmd - 1 : cmd) = '\0';
+
+	*pjob = job;
+	return 0;
+}
+
+
+/***********************************************************************
+ * Tagged output collection
+ */
+static void __update_job_state(struct job *job)
+{
+	if ((job->state == JOB_RUNNING || job->state == JOB_STOPPED) &&
+			!job->nr_alive && !job->nr_outputs) {
+		job->state = JOB_DONE;
+	}
+}
+
+static void __write_all(int fd, const char *buffer, size_t len)
+{
+	while (len) {
+		ssize_t written = write(fd, buffer, len);
+
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		buffer += written;
+		len -= written;
+	}
+}
+
+/**
+ * Emit the lines in @lines[0..@len) after prefixing the job ID. A trailing
+ * partial line is terminated with a newline.
+ */
+static void __emit_lines(struct job_output *o, const char *lines, size_t len)
+{
+	char buffer[MAX_OUTPUT_LINE + 32];
+	size_t used = 0;
+
+	while (len) {
+		const char *nl = memchr(lines, '\n', len);
+		size_t line_len = nl ? nl - lines : len;
+
+		/* Flush first if the line with the prefix may not fit */
+		if (used + line_len + 32 > sizeof(buffer)) {
+			__write_all(o->target, buffer, used);
+			used = 0;
+		}
+
+		used += snprintf(buffer + used, 32, "[%d] ", o->job->id);
+		memcpy(buffer + used, lines, line_len);
+		used += line_len;
+		buffer[used++] = '\n';
+
+		lines += line_len + (nl ? 1 : 0);
+		len -= line_len + (nl ? 1 : 0);
+	}
+	__write_all(o->target, buffer, used);
+}
+
+static void __close_output(struct job_output *o)
+{
+	struct job *job = o->job;
+
+	epoll_ctl(job_epfd, EPOLL_CTL_DEL, o->fd, NULL);
+	close(o->fd);
+
+	for (int i = 0; i < 2; i++) {
+		if (job->outputs[i] == o) job->outputs[i] = NULL;
+	}
+	job->nr_outputs--;
+	free(o);
+
+	__update_job_state(job);
+}
+
+/**
+ * Read the output of a job and emit the complete lines. At most one buffer
+ * is read at a time so that the outputs of jobs are served in turn. When
+ * the shell cannot emit the lines fast enough, the pipe fills up and the
+ * job gets blocked, so the memory usage of the shell stays bounded.
+ */
+static void __pump_output(struct job_output *o)
+{
+	ssize_t nr_read;
+	char *last_nl;
+
+	nr_read = read(o->fd, o->buffer + o->len, sizeof(o->buffer) - o->len);
+	if (nr_read < 0 && (errno == EAGAIN || errno == EINTR)) return;
+
+	if (nr_read <= 0) {
+		/* All the writers are gone. Flush the partial line */
+		if (o->len) __emit_lines(o, o->buffer, o->len);
+		__close_output(o);
+		return;
+	}
+	o->len += nr_read;
+
+	last_nl = memrchr(o->buffer, '\n', o->len);
+	if (!last_nl) {
+		/* A line is too long to fit in the buffer. Break it */
+		if (o->len == sizeof(o->buffer)) {
+			__emit_lines(o, o->buffer, o->len);
+			o->len = 0;
+		}
+		return;
+	}
+
+	__emit_lines(o, o->buffer, last_nl + 1 - o->buffer);
+	o->len -= last_nl + 1 - o->buffer;
+	memmove(o->buffer, last_nl + 1, o->len);
+}
+
+static int __open_outputs(struct job *job, int fds[2][2])
+{
+	for (int i = 0; i < 2; i++) {
+		struct job_output *o;
+		struct epoll_event ev = {
+			.events = EPOLLIN,
+		};
+
+		o = malloc(sizeof(*o));
+		if (!o) return -ENOMEM;
+
+		if (pipe2(fds[i], O_CLOEXEC) < 0) {
+			free(o);
+			return -errno;
+		}
+		fcntl(fds[i][0], F_SETFL, O_NONBLOCK);
+
+		o->job = job;
+		o->fd = fds[i][0];
+		o->target = i == 0 ? STDOUT_FILENO : STDERR_FILENO;
+		o->len = 0;
+
+		ev.data.ptr = o;
+		epoll_ctl(job_epfd, EPOLL_CTL_ADD, o->fd, &ev);
+
+		job->outputs[i] = o;
+		job->nr_outputs++;
+	}
+	return 0;
+}
+
+/**
+ * Wait for events up to @timeout msec, and handle them. Return true if
+ * some children are exited.
+ */
+static bool __handle_events(int timeout)
+{
+	struct epoll_event events[16];
+	bool exited = false;
+	int nr_events;
+
+	nr_events = epoll_wait(job_epfd, events, 16, timeout);
+
+	for (int i = 0; i < nr_events; i++) {
+		if (events[i].data.ptr) {
+			__pump_output(events[i].data.ptr);
+		} else {
+			char buffer[64];
+			while (read(sigchld_pipe[0], buffer, sizeof(buffer)) > 0);
+			exited = true;
+		}
+	}
+	return exited;
+}
+
+void set_job_tagging(bool tagging)
+{
+	job_tagging = tagging;
+}
+
+bool get_job_tagging(void)
+{
+	return job_tagging;
+}
+
+
+/***********************************************************************
+ * Spawn the processes of @job
+ */
+static int __spawn_job(struct job *job)
+{
+	char **argv = job->argv;
+	int prev_fd = -1;
+	int outputs[2][2] = { { -1, -1 }, { -1, -1 } };
+
+	if (job->background && !job->coproc && job_tagging &&
+			__open_outputs(job, outputs)) {
+		fprintf(stderr, "Unable to execute %s\n", argv[0]);
+		goto out;
+	}
+
+	for (int i = 0; i < job->nr_commands; i++) {
+		int fd[2] = { -1, -1 };
+		pid_t pid;
+
+		if (i < job->nr_commands - 1 && pipe(fd) < 0) break;
+
+		pid = fork();
+		if (pid < 0) {
+			fprintf(stderr, "Unable to execute %s\n", argv[0]);
+			if (fd[0] >= 0) {
+				close(fd[0]);
+				close(fd[1]);
+			}
+			break;
+		}
+
+		if (pid == 0) {
+			if (job_control) {
+				setpgid(0, job->pgid);
+				if (!job->background) tcsetpgrp(STDIN_FILENO, job->pgid ? job->pgid : getpid());
+
+				signal(SIGINT, SIG_DFL);
+				signal(SIGQUIT, SIG_DFL);
+				signal(SIGTSTP, SIG_DFL);
+				signal(SIGTTIN, SIG_DFL);
+				signal(SIGTTOU, SIG_DFL);
+			}
+
+			if (job->redirs[i][0] >= 0) {
+				dup2(job->redirs[i][0], STDIN_FILENO);
+				if (prev_fd >= 0) close(prev_fd);
+			} else if (prev_fd >= 0) {
+				dup2(prev_fd, STDIN_FILENO);
+				close(prev_fd);
+			} else if (job->background) {
+				int null_fd = open("/dev/null", O_RDONLY);
+				if (null_fd >= 0) {
+					dup2(null_fd, STDIN_FILENO);
+					close(null_fd);
+				}
+			}
+			if (job->redirs[i][1] >= 0) {
+				dup2(job->redirs[i][1], STDOUT_FILENO);
+			} else if (fd[1] >= 0) {
+				dup2(fd[1], STDOUT_FILENO);
+			} else if (outputs[0][1] >= 0) {
+				dup2(outputs[0][1], STDOUT_FILENO);
+			}
+			if (fd[1] >= 0) {
+				close(fd[1]);
+				close(fd[0]);
+			}
+			if (outputs[1][1] >= 0) {
+				dup2(outputs[1][1], STDERR_FILENO);
+			}
+
+			if (job->paths && job->paths[i]) {
+				execv(job->paths[i], argv);
+			} else if (argv[0]) {
+				execvp(argv[0], argv);
+			}
+			fprintf(stderr, "Unable to execute %s\n", argv[0] ? argv[0] : "|");
+			exit(EXIT_FAILURE);
+		}
+
+		job->pids[i] = pid;
+		job->nr_alive++;
+
+		/* Both sides set the group to avoid racing with each other */
+		if (!job->pgid) job->pgid = pid;
+		if (job_control) setpgid(pid, job->pgid);
+
+		if (prev_fd >= 0) close(prev_fd);
+		if (fd[1] >= 0) close(fd[1]);
+		prev_fd = fd[0];
+
+		/* Move on to the next command */
+		while (*argv) argv++;
+		argv++;
+	}
+	if (prev_fd >= 0) close(prev_fd);
+
+out:
+	/* Leave the read ends only. The pipes get EOF when the job is done */
+	for (int i = 0; i < 2; i++) {
+		if (outputs[i][1] >= 0) close(outputs[i][1]);
+	}
+	if (!job->paths) __close_redirections(job);
+
+	job->state = JOB_RUNNING;
+	if (!job->nr_alive) {
+		job->status = EXIT_FAILURE;
+		__update_job_state(job);
+		return -ECHILD;
+	}
+	return 0;
+}
+
+
+/***********************************************************************
+ * Admission control
+ */
+static int __job_limit(void)
+{
+	long nr_cpus;
+	double load, others;
+	FILE *file;
+	int limit;
+
+	if (job_limit == JOB_LIMIT_NONE) return INT_MAX;
+	if (job_limit > 0) return job_limit;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_cpus < 1) nr_cpus = 1;
+
+	/**
+	 * The load average includes the jobs we are running. Give the CPUs that
+	 * are not occupied by the others to our jobs.
+	 */
+	file = fopen("/proc/loadavg", "r");
+	if (!file) return nr_cpus;
+	if (fscanf(file, "%lf", &load) != 1) load = 0;
+	fclose(file);
+
+	others = load - nr_running;
+	if (others < 0) others = 0;
+
+	limit = nr_cpus - (int)(others + 0.5);
+	return limit < 1 ? 1 : limit;
+}
+
+static void __admit_jobs(void)
+{
+	while (!list_empty(&job_queue)) {
+		struct job *job = list_first_entry(&job_queue, struct job, list);
+
+		/* Always let one job run so that the queue makes progress */
+		if (nr_running > 0 && nr_running >= __job_limit()) break;
+
+		list_move_tail(&job->list, &jobs);
+		if (__spawn_job(job) == 0 && __is_throttled(job)) {
+			job->throttled = true;
+			nr_running++;
+		}
+	}
+}
+
+void set_job_limit(int limit)
+{
+	job_limit = limit;
+	__admit_jobs();
+}
+
+int get_job_limit(void)
+{
+	return __job_limit();
+}
+
+
+/***********************************************************************
+ * Process collection
+ */
+static void __reap(pid_t pid, int status)
+{
+	struct job *job;
+
+	list_for_each_entry(job, &jobs, list) {
+		if (job->state != JOB_RUNNING && job->state != JOB_STOPPED) continue;
+
+		for (int i = 0; i < job->nr_commands; i++) {
+			if (job->pids[i] != pid) continue;
+
+			if (WIFSTOPPED(status)) {
+				job->state = JOB_STOPPED;
+				return;
+			}
+			if (WIFCONTINUED(status)) {
+				job->state = JOB_RUNNING;
+				return;
+			}
+
+			if (i == job->nr_commands - 1) {
+				job->status = WIFEXITED(status) ?
+						WEXITSTATUS(status) : 128 + WTERMSIG(status);
+			}
+			if (--job->nr_alive == 0 && job->throttled) {
+				job->throttled = false;
+				nr_running--;
+			}
+			__update_job_state(job);
+			return;
+		}
+	}
+}
+
+static void __reap_nonblock(void)
+{
+	pid_t pid;
+	int status;
+
+	while ((pid = waitpid(-1, &status,
+			WNOHANG | (job_control ? WUNTRACED | WCONTINUED : 0))) > 0) {
+		__reap(pid, status);
+	}
+
+	if (pid < 0 && errno == ECHILD) {
+		struct job *job;
+
+		/* No child exists. Do not wait for the jobs forever */
+		list_for_each_entry(job, &jobs, list) {
+			if (!job->nr_alive) continue;
+
+			job->nr_alive = 0;
+			if (job->throttled) {
+				job->throttled = false;
+				nr_running--;
+			}
+			__update_job_state(job);
+		}
+	}
+	__admit_jobs();
+}
+
+/**
+ * Wait for @job to complete. The outputs of tagged jobs are served and
+ * queued jobs are admitted in the meantime.
+ */
+static void __wait_job(struct job *job)
+{
+	__reap_nonblock();
+
+	while (job->state == JOB_RUNNING) {
+		if (__handle_events(-1)) __reap_nonblock();
+	}
+}
+
+static int __next_job_id(void)
+{
+	struct job *job;
+	int id = 0;
+
+	list_for_each_entry(job, &jobs, list) {
+		if (job->id > id) id = job->id;
+	}
+	list_for_each_entry(job, &job_queue, list) {
+		if (job->id > id) id = job->id;
+	}
+	return id + 1;
+}
+
+/**
+ * Wait for the foreground @job with the terminal handed over to it. When the
+ * job is stopped, it is turned into a background job.
+ */
+static void __wait_foreground(struct job *job)
+{
+	if (job_control) {
+		tcsetpgrp(STDIN_FILENO, job->pgid);
+		if (job->tmodes_saved) tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+	}
+
+	__wait_job(job);
+
+	if (!job_control) return;
+
+	tcsetpgrp(STDIN_FILENO, shell_pgid);
+	if (job->state == JOB_STOPPED) {
+		job->tmodes_saved = (tcgetattr(STDIN_FILENO, &job->tmodes) == 0);
+	}
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+
+	if (job->state == JOB_STOPPED) {
+		if (!job->id) job->id = __next_job_id();
+		job->background = true;
+		job->status = 128 + SIGTSTP;
+
+		if (job_notify) {
+			fprintf(stderr, "\n[%d] %-8s %s\n",
+					job->id, __job_state_sz[job->state], job->command);
+		}
+	}
+}
+
+void reap_jobs(void)
+{
+	struct job *job, *tmp;
+
+	__reap_nonblock();
+
+	list_for_each_entry_safe(job, tmp, &jobs, list) {
+		if (job->state != JOB_DONE || !job->background || job->notified) continue;
+
+		if (job_notify) {
+			if (job->status) {
+				fprintf(stderr, "[%d] Exit %d %s\n", job->id, job->status, job->command);
+			} else {
+				fprintf(stderr, "[%d] Done %s\n", job->id, job->command);
+			}
+		}
+		job->notified = true;
+
+		if (!job->coproc) __free_job(job);
+	}
+}
+
+void wait_jobs(void)
+{
+	struct job *job;
+
+	while (true) {
+		bool waited = false;
+
+		list_for_each_entry(job, &jobs, list) {
+			if (job->state == JOB_RUNNING && __is_throttled(job)) {
+				__wait_job(job);
+				waited = true;
+				break;
+			}
+		}
+		if (!waited) break;
+	}
+	reap_jobs();
+}
+
+void dump_jobs(void)
+{
+	struct job *job;
+
+	list_for_each_entry(job, &jobs, list) {
+		if (!job->background) continue;
+		if (job->coproc) {
+			fprintf(stderr, "[%d] %-8s coproc %s %s\n",
+					job->id, __job_state_sz[job->state], job->coproc, job->command);
+			continue;
+		}
+		fprintf(stderr, "[%d] %-8s %s\n",
+				job->id, __job_state_sz[job->state], job->command);
+	}
+	list_for_each_entry(job, &job_queue, list) {
+		fprintf(stderr, "[%d] %-8s %s\n",
+				job->id, __job_state_sz[job->state], job->command);
+	}
+}
+
+
+/***********************************************************************
+ * Job execution
+ */
+int run_job(int nr_tokens, char * const tokens[], bool background)
+{
+	struct job *job;
+	int status;
+	int ret;
+
+	if (nr_tokens <= 0) return -EINVAL;
+
+	ret = __alloc_job(nr_tokens, tokens, background, &job);
+	if (ret) {
+		fprintf(stderr, "Unable to execute %s\n", tokens[0]);
+		return ret;
+	}
+
+	if (!background) {
+		list_add_tail(&job->list, &jobs);
+		__spawn_job(job);
+		__wait_foreground(job);
+
+		status = job->status;
+		if (job->state == JOB_DONE) __free_job(job);
+		return status;
+	}
+
+	job->id = __next_job_id();
+	job->state = JOB_QUEUED;
+	list_add_tail(&job->list, &job_queue);
+
+	__admit_jobs();
+
+	if (job_notify) {
+		if (job->state == JOB_QUEUED) {
+			fprintf(stderr, "[%d] Queued\n", job->id);
+		} else {
+			fprintf(stderr, "[%d] %d\n", job->id, job->pids[job->nr_commands - 1]);
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Look up @name from $PATH as execvp() does. Return the newly allocated path
+ * to the executable, or NULL if not found.
+ */
+static char *__resolve_path(const char *name)
+{
+	const char *dirs = getenv("PATH");
+	size_t len = strlen(name);
+
+	if (strchr(name, '/')) return strdup(name);
+	if (!dirs) dirs = "/bin:/usr/bin";
+
+	while (true) {
+		const char *end = strchrnul(dirs, ':');
+		size_t dir_len = end - dirs;
+		char *path = malloc(dir_len + len + 2);
+
+		if (!path) return NULL;
+
+		/* An empty entry stands for the current directory */
+		memcpy(path, dir_len ? dirs : ".", dir_len ? dir_len : 1);
+		dir_len = dir_len ? dir_len : 1;
+		path[dir_len] = '/';
+		memcpy(path + dir_len + 1, name, len + 1);
+
+		if (access(path, X_OK) == 0) return path;
+		free(path);
+
+		if (!*end) break;
+		dirs = end + 1;
+	}
+	return NULL;
+}
+
+struct job *prepare_job(int nr_tokens, char * const tokens[])
+{
+	struct job *job;
+	char **argv;
+
+	if (nr_tokens <= 0) return NULL;
+
+	if (__alloc_job(nr_tokens, tokens, false, &job)) {
+		fprintf(stderr, "Unable to execute %s\n", tokens[0]);
+		return NULL;
+	}
+
+	job->paths = malloc(sizeof(char *) * job->nr_commands);
+	if (!job->paths) {
+		__free_job(job);
+		return NULL;
+	}
+
+	argv = job->argv;
+	for (int i = 0; i < job->nr_commands; i++) {
+		job->paths[i] = argv[0] ? __resolve_path(argv[0]) : NULL;
+
+		while (*argv) argv++;
+		argv++;
+	}
+
+	job->state = JOB_DONE;
+	list_add_tail(&job->list, &jobs);
+
+	return job;
+}
+
+int rerun_job(struct job *job)
+{
+	memset(job->pids, 0x00, sizeof(pid_t) * job->nr_commands);
+	job->nr_alive = 0;
+	job->status = 0;
+	job->pgid = 0;
+
+	/* Here-documents are consumed by the previous run. Rewind them */
+	for (int i = 0; i < job->nr_commands; i++) {
+		if (job->redirs[i][0] >= 0) lseek(job->redirs[i][0], 0, SEEK_SET);
+	}
+
+	__spawn_job(job);
+	__wait_foreground(job);
+
+	/**
+	 * The prepared job belongs to the caller, which does not expect it to
+	 * linger. Terminate it when stopped.
+	 */
+	if (job->state == JOB_STOPPED) {
+		job->background = false;
+		kill(-job->pgid, SIGTERM);
+		kill(-job->pgid, SIGCONT);
+		__wait_job(job);
+		job->status = 128 + SIGTSTP;
+	}
+
+	return job->status;
+}
+
+void release_job(struct job *job)
+{
+	__free_job(job);
+}
+
+bool serve_jobs(int timeout)
+{
+	struct timespec now, deadline;
+
+	interrupted = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	while (true) {
+		long remaining;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = (deadline.tv_sec - now.tv_sec) * 1000 +
+				(deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+		if (remaining <= 0) break;
+
+		if (__handle_events(remaining)) __reap_nonblock();
+		if (interrupted) return false;
+	}
+	return true;
+}
+
+/**
+ * Find the job @id, or the most recent background job when @id is 0
+ */
+static struct job *__find_job(int id)
+{
+	struct job *job, *found = NULL;
+
+	list_for_each_entry(job, &jobs, list) {
+		if (!job->background || job->coproc) continue;
+		if (job->state != JOB_RUNNING && job->state != JOB_STOPPED) continue;
+
+		if (id ? job->id == id : (!found || job->id > found->id)) found = job;
+	}
+	return found;
+}
+
+int fg_job(int id)
+{
+	struct job *job = __find_job(id);
+	int status;
+
+	if (!job) return -ENOENT;
+
+	fprintf(stderr, "%s\n", job->command);
+
+	job->background = false;
+	if (job->state == JOB_STOPPED) {
+		if (job_control) {
+			tcsetpgrp(STDIN_FILENO, job->pgid);
+			if (job->tmodes_saved) tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+		}
+		kill(-job->pgid, SIGCONT);
+		job->state = JOB_RUNNING;
+	}
+	__wait_foreground(job);
+
+	status = job->status;
+	if (job->state == JOB_DONE) __free_job(job);
+	return status;
+}
+
+int bg_job(int id)
+{
+	struct job *job = __find_job(id);
+
+	if (!job) return -ENOENT;
+	if (job->state != JOB_STOPPED) return 0;
+
+	kill(-job->pgid, SIGCONT);
+	job->state = JOB_RUNNING;
+
+	if (job_notify) {
+		fprintf(stderr, "[%d] %s &\n", job->id, job->command);
+	}
+	return 0;
+}
+
+int run_coproc(const char *name, int nr_tokens, char * const tokens[])
+{
+	struct job *job;
+	int in[2], out[2];
+	int ret;
+
+	if (nr_tokens <= 0) return -EINVAL;
+
+	job = __find_coproc(name);
+	if (job) {
+		if (job->state != JOB_DONE) {
+			fprintf(stderr, "Coprocess %s already exists\n", name);
+			return -EEXIST;
+		}
+		/* Replace the exited one */
+		__free_job(job);
+	}
+
+	ret = __alloc_job(nr_tokens, tokens, true, &job);
+	if (ret) goto out_err;
+
+	job->coproc = strdup(name);
+	if (!job->coproc) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	/* The shell keeps the ends not passed to the coprocess, close-on-exec */
+	if (pipe2(in, O_CLOEXEC) < 0) {
+		ret = -errno;
+		goto out_free;
+	}
+	if (pipe2(out, O_CLOEXEC) < 0) {
+		ret = -errno;
+		close(in[0]);
+		close(in[1]);
+		goto out_free;
+	}
+
+	if (job->redirs[0][0] >= 0) close(job->redirs[0][0]);
+	job->redirs[0][0] = in[0];
+	if (job->redirs[job->nr_commands - 1][1] >= 0) close(job->redirs[job->nr_commands - 1][1]);
+	job->redirs[job->nr_commands - 1][1] = out[1];
+
+	job->coproc_fds[0] = in[1];
+	job->coproc_fds[1] = out[0];
+
+	job->id = __next_job_id();
+	list_add_tail(&job->list, &jobs);
+
+	ret = __spawn_job(job);
+	if (ret) goto out_err;
+
+	if (job_notify) {
+		fprintf(stderr, "[%d] %d\n", job->id, job->pids[job->nr_commands - 1]);
+	}
+	return 0;
+
+out_free:
+	__free_job(job);
+out_err:
+	fprintf(stderr, "Unable to execute %s\n", tokens[0]);
+	return ret;
+}
+
+int close_coproc(const char *name)
+{
+	struct job *job = __find_coproc(name);
+
+	if (!job || job->coproc_fds[0] < 0) return -ENOENT;
+
+	close(job->coproc_fds[0]);
+	job->coproc_fds[0] = -1;
+	return 0;
+}
+
+
+/***********************************************************************
+ * Waiting for input
+ */
+static void __sigchld_handler(int signal)
+{
+	int saved_errno = errno;
+
+	if (write(sigchld_pipe[1], "", 1) < 0) {
+		/* The pipe is full, which is fine as the wake-up is pending */
+	}
+	errno = saved_errno;
+}
+
+static void __sigint_handler(int signal)
+{
+	interrupted = 1;
+	__sigchld_handler(signal);
+}
+
+void wait_for_input(int fd)
+{
+	struct pollfd fds[2] = {
+		{ .fd = fd, .events = POLLIN },
+		{ .fd = job_epfd, .events = POLLIN },
+	};
+
+	while (true) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			if (__handle_events(0)) __reap_nonblock();
+		}
+
+		if (fds[0].revents) return;
+	}
+}
+
+int initialize_jobs(bool notify)
+{
+	struct sigaction sa = {
+		.sa_handler = __sigchld_handler,
+		.sa_flags = SA_RESTART,
+	};
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = NULL,	/* Mark the SIGCHLD self-pipe */
+	};
+
+	job_notify = notify;
+	heredoc_input = stdin;
+
+	if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK) < 0) return -errno;
+
+	job_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (job_epfd < 0) return -errno;
+	if (epoll_ctl(job_epfd, EPOLL_CTL_ADD, sigchld_pipe[0], &ev) < 0) return -errno;
+
+	job_control = isatty(STDIN_FILENO);
+	if (job_control) {
+		/* Wait until we are put in the foreground */
+		while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+			kill(-shell_pgid, SIGTTIN);
+		}
+
+		/**
+		 * The keyboard signals are for the foreground job. SIGINT is caught
+		 * rather than ignored to cancel what the shell itself is waiting for
+		 */
+		struct sigaction sa_int = {
+			.sa_handler = __sigint_handler,
+			.sa_flags = SA_RESTART,
+		};
+		sigemptyset(&sa_int.sa_mask);
+		sigaction(SIGINT, &sa_int, NULL);
+		signal(SIGQUIT, SIG_IGN);
+		signal(SIGTSTP, SIG_IGN);
+		signal(SIGTTIN, SIG_IGN);
+		signal(SIGTTOU, SIG_IGN);
+
+		shell_pgid = getpid();
+		if (getpgrp() != shell_pgid && setpgid(shell_pgid, shell_pgid) < 0) {
+			return -errno;
+		}
+		tcsetpgrp(STDIN_FILENO, shell_pgid);
+		tcgetattr(STDIN_FILENO, &shell_tmodes);
+	} else {
+		/* Stopped children are not reported without job control */
+		sa.sa_flags |= SA_NOCLDSTOP;
+	}
+
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGCHLD, &sa, NULL) < 0) return -errno;
+
+	return 0;
+}
+
+void finalize_jobs(void)
+{
+	struct job *job;
+
+	/* Let the coprocesses see EOF */
+	list_for_each_entry(job, &jobs, list) {
+		if (job->coproc && job->coproc_fds[0] >= 0) {
+			close(job->coproc_fds[0]);
+			job->coproc_fds[0] = -1;
+		}
+	}
+
+	/* Queued jobs are requested but not started yet. Run them through */
+	if (!list_empty(&job_queue)) {
+		wait_jobs();
+	}
+}
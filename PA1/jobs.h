@@ -0,0 +1,273 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#define JOB_LIMIT_AUTO	0	/* Derive the limit from the load and # of CPUs */
+#define JOB_LIMIT_NONE	-1	/* Do not throttle background jobs */
+
+#define MAX_OUTPUT_LINE	4096	/* Longer lines of tagged jobs are broken */
+#define MAX_HEREDOCS	16		/* Here-documents in a command line */
+
+struct job;
+
+/**
+ * Bodies of the here-documents read ahead for a command line. The next job
+ * takes the ones in [@next, @end). See read_heredocs()
+ */
+struct heredocs {
+	int fds[MAX_HEREDOCS];
+	int nr_fds;
+	int next;
+	int end;
+};
+
+
+/***********************************************************************
+ * run_job()
+ *
+ * DESCRIPTION
+ *  Run @tokens as a job. @tokens may consist of multiple commands
+ *  connected with "|" tokens, which are run as a pipeline. For example,
+ *   tokens = { "cat", "pa1.c", "|", "sort", "|", "uniq", NULL }
+ *
+ *  runs three processes that are connected by two pipes.
+ *
+ *  The standard input of a command can be given in place with
+ *
+ *   cmd <<DELIM     Here-document; the following input lines up to DELIM
+ *   cmd <<-DELIM    Ditto, with the leading tabs of the lines stripped
+ *   cmd <<<WORD     Here-string; WORD followed by a newline
+ *
+ *  The bodies are kept in anonymous memory files (memfd_create(2)), not in
+ *  temporary files.
+ *
+ *  When @background is false, wait for the job to complete. Otherwise,
+ *  the job is admitted to run only when the number of running background
+ *  jobs is below the job limit (see set_job_limit()). Jobs that are not
+ *  admitted wait in FIFO order, and are started as running jobs complete.
+ *  Background jobs read from /dev/null instead of the standard input of
+ *  the shell.
+ *
+ * RETURN VALUE
+ *  Return the exit status of the last command in the pipeline when
+ *  @background is false. Return 0 when a background job is accepted.
+ *  Return <0 on error
+ */
+int run_job(int nr_tokens, char * const tokens[], bool background);
+
+
+/***********************************************************************
+ * read_heredocs() / use_heredocs() / take_heredocs() / drop_heredocs()
+ *
+ * DESCRIPTION
+ *  The bodies of the here-documents follow the command line in the input,
+ *  so they should be read before any command of the line runs. Otherwise,
+ *  the body of a command skipped by && or || would be read as commands.
+ *
+ *  read_heredocs() reads the bodies of the here-documents in @tokens ahead
+ *  into @heredocs in order, following the ones read ahead so far.
+ *  use_heredocs() makes the jobs take the bodies from @heredocs, and
+ *  take_heredocs() lets the next job take the @nr bodies from the
+ *  @first-th one. A command line keeps its own @heredocs, so a command line
+ *  run in the middle of another, e.g., by a history recall, does not touch
+ *  the bodies of the outer one. drop_heredocs() closes the ones not taken
+ *  at the end of the command line. A job reads its here-documents by itself
+ *  if nothing is left for it to take.
+ *
+ * RETURN VALUE
+ *  read_heredocs() returns the number of bodies read, or <0 on error.
+ *  use_heredocs() returns the ones used so far to put back later.
+ */
+int read_heredocs(struct heredocs *heredocs, int nr_tokens, char * const tokens[]);
+struct heredocs *use_heredocs(struct heredocs *heredocs);
+void take_heredocs(struct heredocs *heredocs, int first, int nr);
+void drop_heredocs(struct heredocs *heredocs);
+
+
+/***********************************************************************
+ * prepare_job() / rerun_job() / release_job()
+ *
+ * DESCRIPTION
+ *  Build a foreground job out of @tokens to run it over and over. The
+ *  tokens are copied, split into commands, and the executables are looked
+ *  up from $PATH once in prepare_job(). Redirections are also set up once
+ *  and kept open until the job is released. rerun_job() only creates the
+ *  pipes between the commands and spawns the processes.
+ *
+ * RETURN VALUE
+ *  prepare_job() returns the job, or NULL on error.
+ *  rerun_job() returns the exit status of the last command in the job.
+ */
+struct job *prepare_job(int nr_tokens, char * const tokens[]);
+int rerun_job(struct job *job);
+void release_job(struct job *job);
+
+
+/***********************************************************************
+ * serve_jobs()
+ *
+ * DESCRIPTION
+ *  Serve the job events (collecting finished processes, admitting queued
+ *  jobs, and emitting tagged outputs) for @timeout msec.
+ *
+ * RETURN VALUE
+ *  Return false if interrupted by Ctrl-C in the meantime, true otherwise.
+ */
+bool serve_jobs(int timeout);
+
+
+/***********************************************************************
+ * run_coproc()
+ *
+ * DESCRIPTION
+ *  Start @tokens as a coprocess named @name. A coprocess is a long-lived
+ *  background job whose standard input and output are connected to the
+ *  shell through pipes. Later commands talk to it with the redirections
+ *
+ *   cmd >&p         Write the stdout of cmd to the most recent coprocess
+ *   cmd <&p         Read the stdin of cmd from the most recent coprocess
+ *   cmd >&p:NAME    Ditto, for the coprocess @name
+ *   cmd <&p:NAME
+ *
+ *  so that a filter can serve many requests without being restarted.
+ *  Coprocesses are not subject to the job limit, and wait_jobs() does not
+ *  wait for them. close_coproc() closes the pipe to the stdin of the
+ *  coprocess @name (or the most recent one when NULL) so that it sees EOF.
+ *
+ * RETURN VALUE
+ *  Return 0 on success, and <0 on error.
+ */
+int run_coproc(const char *name, int nr_tokens, char * const tokens[]);
+int close_coproc(const char *name);
+
+
+/***********************************************************************
+ * fg_job() / bg_job()
+ *
+ * DESCRIPTION
+ *  Implement the "fg" and "bg" built-in commands. fg_job() brings the job
+ *  @id (or the most recent background job when @id is 0) to the foreground,
+ *  continues it if stopped, and waits for it. bg_job() continues the stopped
+ *  job @id in background.
+ *
+ *  When the shell runs on a terminal, each job is run in its own process
+ *  group and the foreground job owns the terminal. So Ctrl-C and Ctrl-Z
+ *  reach the foreground job only, and a job stopped with Ctrl-Z is kept as
+ *  a stopped background job.
+ *
+ * RETURN VALUE
+ *  fg_job() returns the exit status of the job. bg_job() returns 0.
+ *  Return <0 if the job does not exist.
+ */
+int fg_job(int id);
+int bg_job(int id);
+
+
+/***********************************************************************
+ * reap_jobs()
+ *
+ * DESCRIPTION
+ *  Collect finished processes without blocking, start the queued jobs
+ *  that can be admitted, and report completed background jobs.
+ */
+void reap_jobs(void);
+
+
+/***********************************************************************
+ * wait_jobs()
+ *
+ * DESCRIPTION
+ *  Wait until all background jobs, including the queued ones, complete.
+ *  Coprocesses are not waited for.
+ */
+void wait_jobs(void);
+
+
+/***********************************************************************
+ * dump_jobs()
+ *
+ * DESCRIPTION
+ *  Print out the background jobs in the following format.
+ *
+ *   fprintf(stderr, "[%d] %-8s %s\n", id, state, command);
+ */
+void dump_jobs(void);
+
+
+/***********************************************************************
+ * set_job_limit()
+ *
+ * DESCRIPTION
+ *  Set the maximum number of background jobs that run concurrently to
+ *  @limit. JOB_LIMIT_AUTO (default) derives the limit from the number of
+ *  online CPUs minus the load from the others in /proc/loadavg.
+ *  JOB_LIMIT_NONE admits all jobs immediately.
+ *
+ *  get_job_limit() returns the limit in effect at the moment.
+ */
+void set_job_limit(int limit);
+int get_job_limit(void);
+
+
+/***********************************************************************
+ * set_job_tagging()
+ *
+ * DESCRIPTION
+ *  When @tagging is true, the shell collects the standard output and
+ *  error of background jobs started afterward through pipes, and emits
+ *  them line by line with the job ID prefixed as follows;
+ *
+ *   [2] output line from job 2
+ *   [1] output line from job 1
+ *
+ *  so that the lines of concurrent jobs do not get mixed. A line longer
+ *  than MAX_OUTPUT_LINE is broken into multiple lines. A job is considered
+ *  done only after its outputs are drained.
+ *
+ *  get_job_tagging() returns the current setting.
+ */
+void set_job_tagging(bool tagging);
+bool get_job_tagging(void);
+
+
+/***********************************************************************
+ * wait_for_input()
+ *
+ * DESCRIPTION
+ *  Block until @fd becomes readable. Finished processes are collected and
+ *  queued jobs are started in the meantime, so that the job queue makes
+ *  progress while the shell is waiting for the next command.
+ */
+void wait_for_input(int fd);
+
+
+/***********************************************************************
+ * initialize_jobs() / finalize_jobs()
+ *
+ * DESCRIPTION
+ *  Set up and tear down the job table. Job notifications are printed out
+ *  only when @notify is true. finalize_jobs() runs the queued jobs to
+ *  completion since they were requested but have not been started yet,
+ *  and closes the pipes to the coprocesses.
+ *
+ * RETURN VALUE
+ *  initialize_jobs() returns 0 on success, and <0 on error.
+ */
+int initialize_jobs(bool notify);
+void finalize_jobs(void);
+
+#endif
@@ -31,6 +31,8 @@ int parse_command(char *command, int *nr_tokens, char *tokens[])
 			token_started = false;
 		} else {
 			if (!token_started) {
+				/* Keep the last slot for the terminating NULL */
+				if (*nr_tokens == MAX_NR_TOKENS - 1) return false;
 				tokens[*nr_tokens] = curr;
 				*nr_tokens += 1;
 				token_started = true;
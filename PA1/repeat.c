@@ -0,0 +1,151 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+
+#include "types.h"
+#include "jobs.h"
+#include "repeat.h"
+
+#define DEFAULT_WATCH_INTERVAL	2.0
+
+struct latency_hist {
+	unsigned long buckets[NR_LATENCY_BUCKETS];	/* [i] counts < 2^i usec */
+	unsigned long nr;
+	long long min, max, sum;	/* in usec */
+};
+
+static long long __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void __record_latency(struct latency_hist *hist, long long usec)
+{
+	int bucket = 0;
+
+	while (bucket < NR_LATENCY_BUCKETS - 1 && (1LL << bucket) <= usec) bucket++;
+	hist->buckets[bucket]++;
+
+	if (!hist->nr || usec < hist->min) hist->min = usec;
+	if (!hist->nr || usec > hist->max) hist->max = usec;
+	hist->sum += usec;
+	hist->nr++;
+}
+
+static void __print_latency(struct latency_hist *hist)
+{
+	unsigned long peak = 0;
+
+	if (!hist->nr) return;
+
+	fprintf(stderr, "runs %lu, min %lld us, avg %lld us, max %lld us\n",
+			hist->nr, hist->min, hist->sum / (long long)hist->nr, hist->max);
+
+	for (int i = 0; i < NR_LATENCY_BUCKETS; i++) {
+		if (hist->buckets[i] > peak) peak = hist->buckets[i];
+	}
+
+	for (int i = 0; i < NR_LATENCY_BUCKETS; i++) {
+		int width;
+
+		if (!hist->buckets[i]) continue;
+
+		width = (hist->buckets[i] * 40 + peak - 1) / peak;
+		fprintf(stderr, "  < %10lld us %8lu |%.*s\n", 1LL << i,
+				hist->buckets[i], width,
+				"########################################");
+	}
+}
+
+int run_repeat(int nr_tokens, char * const tokens[])
+{
+	bool watch = (strcmp(tokens[0], "watch") == 0);
+	struct latency_hist hist = { 0 };
+	double interval = watch ? DEFAULT_WATCH_INTERVAL : 0;
+	long long period, next;
+	long count = watch ? -1 : 0;
+	struct job *job;
+	int status = 0;
+	int i;
+
+	for (i = 1; i + 1 < nr_tokens && tokens[i][0] == '-'; i += 2) {
+		if (strcmp(tokens[i], "-n") == 0) {
+			count = atol(tokens[i + 1]);
+		} else if (strcmp(tokens[i], "-i") == 0) {
+			interval = atof(tokens[i + 1]);
+		} else {
+			break;
+		}
+	}
+
+	if (i >= nr_tokens || (!watch && count <= 0) || interval < 0) {
+		fprintf(stderr, "Unable to execute %s\n", tokens[0]);
+		return -EINVAL;
+	}
+
+	job = prepare_job(nr_tokens - i, tokens + i);
+	if (!job) return -EINVAL;
+
+	period = (long long)(interval * 1e9);
+	next = __now_ns();
+
+	for (long run = 0; count < 0 || run < count; run++) {
+		long long start;
+
+		/* Sleep until the next slot, serving background jobs meanwhile */
+		start = __now_ns();
+		if (start < next) {
+			if (!serve_jobs((next - start + 999999) / 1000000)) break;
+			start = __now_ns();
+		}
+
+		if (watch) {
+			fprintf(stderr, "Every %.1fs:", interval);
+			for (int j = i; j < nr_tokens; j++) {
+				fprintf(stderr, " %s", tokens[j]);
+			}
+			fprintf(stderr, "\n");
+		}
+
+		status = rerun_job(job);
+		__record_latency(&hist, (__now_ns() - start) / 1000);
+
+		if (watch && status) break;
+
+		/* Interrupted from the keyboard. Stop repeating as well */
+		if (status == 128 + SIGINT || status == 128 + SIGQUIT ||
+				status == 128 + SIGTSTP) break;
+
+		/* Skip the slots that are already missed */
+		next += period;
+		if (period && next < __now_ns()) {
+			next += ((__now_ns() - next) / period + 1) * period;
+		}
+	}
+
+	release_job(job);
+	__print_latency(&hist);
+
+	return status;
+}
@@ -0,0 +1,46 @@
+/**********************************************************************
+ * Copyright (c) 2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __REPEAT_H__
+#define __REPEAT_H__
+
+#define NR_LATENCY_BUCKETS	32	/* log2(usec) buckets of the histogram */
+
+
+/***********************************************************************
+ * run_repeat()
+ *
+ * DESCRIPTION
+ *  Implement the "repeat" and "watch" built-in commands.
+ *
+ *   repeat -n N [-i SEC] cmd ...
+ *   watch [-n N] [-i SEC] cmd ...
+ *
+ *  "repeat" runs cmd N times back to back, or every SEC seconds when -i is
+ *  given. "watch" runs cmd every SEC seconds (2 by default) with a header
+ *  line until cmd fails or it has run N times. The commands are started at
+ *  fixed rate; the interval is measured from the start of the previous run
+ *  rather than from its end, so slow runs do not make the schedule drift.
+ *
+ *  The command line is parsed and its executables are resolved only once
+ *  (see prepare_job()). After the runs, the latency histogram of the runs
+ *  is printed out to stderr.
+ *
+ * RETURN VALUE
+ *  Return the exit status of the last run, or <0 on error.
+ */
+int run_repeat(int nr_tokens, char * const tokens[]);
+
+#endif
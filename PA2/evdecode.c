@@ -0,0 +1,71 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/**
+ * Decode the binary event log written with "sched -l" into the text that
+ * the simulator prints to stderr otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "evlog.h"
+
+#define NR_RECORDS_PER_READ	4096
+
+int main(int argc, char * const argv[])
+{
+	struct event_log_header header;
+	struct event_record *records;
+	size_t nr;
+	FILE *in;
+
+	if (argc != 2) {
+		printf("Usage: %s [event log file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	in = fopen(argv[1], "rb");
+	if (!in) {
+		fprintf(stderr, "Unable to open %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	if (fread(&header, sizeof(header), 1, in) != 1 ||
+			memcmp(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic)) ||
+			header.record_size != sizeof(struct event_record)) {
+		fprintf(stderr, "%s is not an event log\n", argv[1]);
+		fclose(in);
+		return EXIT_FAILURE;
+	}
+
+	records = malloc(sizeof(*records) * NR_RECORDS_PER_READ);
+	if (!records) {
+		fclose(in);
+		return EXIT_FAILURE;
+	}
+
+	while ((nr = fread(records, sizeof(*records), NR_RECORDS_PER_READ, in)) > 0) {
+		for (size_t i = 0; i < nr; i++) {
+			print_event(stdout, records + i, header.nr_cpus > 1);
+		}
+	}
+
+	free(records);
+	fclose(in);
+	return EXIT_SUCCESS;
+}
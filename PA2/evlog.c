@@ -0,0 +1,155 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "types.h"
+#include "evlog.h"
+
+static int log_fd = -1;
+static char *log_buffer = NULL;
+static size_t log_used = 0;
+
+static inline void __print_tick(FILE *out, unsigned int tick, int cpu, bool show_cpu)
+{
+	if (show_cpu) {
+		fprintf(out, "%3d: [%2d] ", tick, cpu);
+	} else {
+		fprintf(out, "%3d: ", tick);
+	}
+}
+
+void print_event(FILE *out, const struct event_record *ev, bool show_cpu)
+{
+	unsigned int tick = ev->tick;
+
+	switch (ev->type) {
+	case EVENT_IDLE:
+		__print_tick(out, tick, ev->cpu, show_cpu);
+		fprintf(out, "idle\n");
+		return;
+	case EVENT_IDLE_SPAN:
+		/* All the CPUs are idle */
+		fprintf(out, "%3d: idle for %u ticks\n", tick, ev->arg);
+		return;
+	case EVENT_RUN:
+		/* Each tick of the run is a line of its own */
+		for (unsigned int i = 0; i < ev->arg; i++) {
+			__print_tick(out, tick + i, ev->cpu, show_cpu);
+			fprintf(out, "%*s%d\n", ev->pid * 4, "", ev->pid);
+		}
+		return;
+	}
+
+	__print_tick(out, tick, ev->cpu, show_cpu);
+	fprintf(out, "%*s", ev->pid * 4, "");
+
+	switch (ev->type) {
+	case EVENT_FORK:
+		fprintf(out, "N\n");
+		break;
+	case EVENT_EXIT:
+		fprintf(out, "X\n");
+		break;
+	case EVENT_BLOCK:
+		fprintf(out, "=\n");
+		break;
+	case EVENT_ACQUIRE:
+		fprintf(out, "+%d\n", ev->arg);
+		break;
+	case EVENT_RELEASE:
+		fprintf(out, "-%d\n", ev->arg);
+		break;
+	case EVENT_MIGRATE:
+		fprintf(out, "<%u\n", ev->arg);
+		break;
+	default:
+		fprintf(out, "?%d\n", ev->type);
+		break;
+	}
+}
+
+static int __flush_event_log(void)
+{
+	size_t written = 0;
+
+	while (written < log_used) {
+		ssize_t ret = write(log_fd, log_buffer + written, log_used - written);
+
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			return -errno;
+		}
+		written += ret;
+	}
+	log_used = 0;
+	return 0;
+}
+
+int open_event_log(const char *path, unsigned int nr_cpus)
+{
+	struct event_log_header header = {
+		.magic = EVENT_LOG_MAGIC,
+		.record_size = sizeof(struct event_record),
+		.nr_cpus = nr_cpus,
+	};
+
+	log_buffer = malloc(EVENT_LOG_BUFFER);
+	if (!log_buffer) return -ENOMEM;
+
+	log_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (log_fd < 0) {
+		int ret = -errno;
+
+		free(log_buffer);
+		log_buffer = NULL;
+		return ret;
+	}
+
+	memcpy(log_buffer, &header, sizeof(header));
+	log_used = sizeof(header);
+	return 0;
+}
+
+void log_event(const struct event_record *ev)
+{
+	if (log_used + sizeof(*ev) > EVENT_LOG_BUFFER) {
+		if (__flush_event_log()) {
+			fprintf(stderr, "Unable to write the event log\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(log_buffer + log_used, ev, sizeof(*ev));
+	log_used += sizeof(*ev);
+}
+
+void close_event_log(void)
+{
+	if (log_fd < 0) return;
+
+	if (__flush_event_log()) {
+		fprintf(stderr, "Unable to write the event log\n");
+	}
+	close(log_fd);
+	free(log_buffer);
+
+	log_fd = -1;
+	log_buffer = NULL;
+}
@@ -0,0 +1,86 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __EVLOG_H__
+#define __EVLOG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Binary event log. Each simulation event is stored as a fixed-size record
+ * instead of a formatted line, and the records are written out through a
+ * large buffer. evdecode turns a log back into the text the simulator
+ * prints to stderr.
+ */
+#define EVENT_LOG_MAGIC		"SCHEDEVT"
+#define EVENT_LOG_BUFFER	(1 << 20)	/* Bytes to buffer before writing */
+
+enum event_type {
+	EVENT_FORK = 0,		/* N */
+	EVENT_EXIT,			/* X */
+	EVENT_RUN,			/* pid, for @arg consecutive ticks from @tick */
+	EVENT_BLOCK,		/* = */
+	EVENT_ACQUIRE,		/* +resource */
+	EVENT_RELEASE,		/* -resource */
+	EVENT_IDLE,			/* idle */
+	EVENT_IDLE_SPAN,	/* idle for @arg ticks (-e) */
+	EVENT_MIGRATE,		/* <cpu; moved in from CPU @arg */
+	NR_EVENT_TYPES,
+};
+
+struct event_log_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t nr_cpus;
+};
+
+struct event_record {
+	uint32_t tick;
+	int32_t pid;
+	uint32_t arg;		/* Resource ID or number of ticks */
+	uint8_t type;		/* enum event_type */
+	uint8_t cpu;
+	uint8_t reserved[2];
+};
+
+
+/***********************************************************************
+ * print_event()
+ *
+ * DESCRIPTION
+ *  Print @ev to @out in the text format of the simulator. The CPU of the
+ *  event is printed next to the tick when @show_cpu is true.
+ */
+void print_event(FILE *out, const struct event_record *ev, bool show_cpu);
+
+
+/***********************************************************************
+ * open_event_log() / log_event() / close_event_log()
+ *
+ * DESCRIPTION
+ *  Write the events into the file @path instead of printing them out.
+ *  @nr_cpus is recorded to tell the decoder how to print. log_event()
+ *  appends a record to the buffer, which is flushed when it fills up and
+ *  when the log is closed.
+ *
+ * RETURN VALUE
+ *  open_event_log() returns 0 on success, and <0 on error.
+ */
+int open_event_log(const char *path, unsigned int nr_cpus);
+void log_event(const struct event_record *ev);
+void close_event_log(void);
+
+#endif
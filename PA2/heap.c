@@ -0,0 +1,125 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "types.h"
+#include "heap.h"
+
+static inline void __place(struct heap *heap, unsigned int index, struct heap_node *node)
+{
+	heap->nodes[index] = node;
+	node->index = index;
+}
+
+static void __sift_up(struct heap *heap, unsigned int index)
+{
+	struct heap_node *node = heap->nodes[index];
+
+	while (index > 1) {
+		struct heap_node *parent = heap->nodes[index / 2];
+
+		if (!heap->before(node, parent)) break;
+
+		__place(heap, index, parent);
+		index /= 2;
+	}
+	__place(heap, index, node);
+}
+
+static void __sift_down(struct heap *heap, unsigned int index)
+{
+	struct heap_node *node = heap->nodes[index];
+
+	while (index * 2 <= heap->nr) {
+		unsigned int child = index * 2;
+
+		if (child < heap->nr &&
+				heap->before(heap->nodes[child + 1], heap->nodes[child])) {
+			child++;
+		}
+		if (!heap->before(heap->nodes[child], node)) break;
+
+		__place(heap, index, heap->nodes[child]);
+		index = child;
+	}
+	__place(heap, index, node);
+}
+
+void heap_init(struct heap *heap,
+		bool (*before)(const struct heap_node *, const struct heap_node *))
+{
+	heap->nodes = NULL;
+	heap->nr = heap->size = 0;
+	heap->before = before;
+}
+
+void heap_destroy(struct heap *heap)
+{
+	for (unsigned int i = 1; i <= heap->nr; i++) {
+		heap->nodes[i]->index = 0;
+	}
+	free(heap->nodes);
+	heap_init(heap, heap->before);
+}
+
+int heap_push(struct heap *heap, struct heap_node *node)
+{
+	if (heap->nr + 1 >= heap->size) {
+		unsigned int size = heap->size ? heap->size * 2 : 64;
+		struct heap_node **nodes = realloc(heap->nodes, sizeof(*nodes) * size);
+
+		if (!nodes) return -ENOMEM;
+		heap->nodes = nodes;
+		heap->size = size;
+	}
+
+	heap->nodes[++heap->nr] = node;
+	__sift_up(heap, heap->nr);
+	return 0;
+}
+
+void heap_remove(struct heap *heap, struct heap_node *node)
+{
+	unsigned int index = node->index;
+	struct heap_node *last = heap->nodes[heap->nr--];
+
+	node->index = 0;
+	if (last == node) return;
+
+	/* Fill the hole with the last one, which may go either way */
+	__place(heap, index, last);
+	heap_update(heap, last);
+}
+
+struct heap_node *heap_pop(struct heap *heap)
+{
+	struct heap_node *node = heap_peek(heap);
+
+	if (node) heap_remove(heap, node);
+	return node;
+}
+
+void heap_update(struct heap *heap, struct heap_node *node)
+{
+	unsigned int index = node->index;
+
+	if (index > 1 && heap->before(node, heap->nodes[index / 2])) {
+		__sift_up(heap, index);
+	} else {
+		__sift_down(heap, index);
+	}
+}
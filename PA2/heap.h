@@ -0,0 +1,83 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __HEAP_H__
+#define __HEAP_H__
+
+/**
+ * Intrusive, indexed binary heap. Embed struct heap_node into the structure
+ * to queue, and get the structure back with container_of(). The node keeps
+ * its position in the heap so that an arbitrary node can be removed or
+ * re-positioned after its key is changed in O(log n).
+ *
+ * Positions start from 1, and 0 means the node is not queued. So a node in
+ * a zero-initialized structure is ready to use.
+ */
+struct heap_node {
+	unsigned int index;
+};
+
+struct heap {
+	struct heap_node **nodes;	/* nodes[1..nr] */
+	unsigned int nr;
+	unsigned int size;
+
+	/* Return true if @a should come out earlier than @b */
+	bool (*before)(const struct heap_node *a, const struct heap_node *b);
+};
+
+static inline bool heap_queued(const struct heap_node *node)
+{
+	return node->index != 0;
+}
+
+static inline bool heap_empty(const struct heap *heap)
+{
+	return heap->nr == 0;
+}
+
+static inline struct heap_node *heap_peek(const struct heap *heap)
+{
+	return heap->nr ? heap->nodes[1] : NULL;
+}
+
+void heap_init(struct heap *heap,
+		bool (*before)(const struct heap_node *, const struct heap_node *));
+void heap_destroy(struct heap *heap);
+
+/***********************************************************************
+ * heap_push()
+ *
+ * DESCRIPTION
+ *  Queue @node into @heap.
+ *
+ * RETURN VALUE
+ *  Return 0 on success, -ENOMEM if @heap cannot grow.
+ */
+int heap_push(struct heap *heap, struct heap_node *node);
+
+/***********************************************************************
+ * heap_pop() / heap_remove() / heap_update()
+ *
+ * DESCRIPTION
+ *  heap_pop() dequeues and returns the node that comes first, or NULL if
+ *  @heap is empty. heap_remove() dequeues @node wherever it is.
+ *  heap_update() restores the heap order after the key of @node is changed.
+ */
+struct heap_node *heap_pop(struct heap *heap);
+void heap_remove(struct heap *heap, struct heap_node *node);
+void heap_update(struct heap *heap, struct heap_node *node);
+
+#endif
@@ -28,42 +28,386 @@ struct BoostingType {
     bool pip;
     bool pcp;
 };
-struct BoostingType boostingType = {
+__thread struct BoostingType boostingType = {
         .pip = false,
         .pcp = false
 };
-bool first;
+__thread bool first;
 
 /**
- * The process which is currently running
+ * The process which is currently running, the ready queue, the resources,
+ * the ticks, and the CPU being simulated. They are those of the simulation
+ * of this thread. See simulation.h
  */
 #include "process.h"
-extern struct process *current;
+#include "prio_array.h"
+#include "resource.h"
+#include "simulation.h"
+#include "evlog.h"
 
 
 /**
- * List head to hold the processes ready to run
+ * Quiet mode. True if the program was started with -q option
  */
-extern struct list_head readyqueue;
+extern bool quiet;
 
 
 /**
- * Resources in the system.
+ * Target latency and minimum granularity of CFS in ticks. Set with -L and
+ * -G options
  */
-#include "resource.h"
-extern struct resource resources[NR_RESOURCES];
+extern unsigned int cfs_latency;
+extern unsigned int cfs_min_granularity;
 
 
 /**
- * Monotonically increasing ticks
+ * Number of levels, the quantum of each level, and the boost period of
+ * MLFQ in ticks. Set with -N, -T, and -B options
  */
-extern unsigned int ticks;
+extern unsigned int mlfq_levels;
+extern unsigned int mlfq_quanta[];
+extern unsigned int mlfq_boost_period;
+
+
+/***********************************************************************
+ * Ready queue index
+ *
+ * DESCRIPTION
+ *   The schedulers that pick the next process by a key index the ready
+ *   processes as well, so that they do not scan the whole @readyqueue on
+ *   every tick; SJF, SRTF, EDF, and RM with @heap, the priority schedulers
+ *   and MLFQ with @prio_rq, and CFS with @timeline. @readyqueue is still
+ *   maintained as it is since the framework looks into it.
+ *
+ *   The order in @readyqueue breaks the ties of the keys. To compare the
+ *   order in O(1), each process is given a sequence number when it is put
+ *   into the ready queue; decreasing ones at the head, and increasing ones
+ *   at the tail.
+ *
+ *   When the ready processes age, all of them get older at the same pace.
+ *   So instead of raising the priority of each one, @epoch counts how many
+ *   times they aged, and a process records the epoch when it got ready.
+ *   Its priority is then prio + (@epoch - rq_epoch), which is brought into
+ *   @prio when it leaves the ready queue.
+ *
+ *   Each CPU has its own ready queue, and so does its index. @readyqueue
+ *   is the one of @this_cpu.
+ ***********************************************************************/
+struct ready_index {
+	struct heap heap;
+	struct prio_array prio_rq;
+	long long head_seq;
+	long long tail_seq;
+	long long epoch;
+
+	/* See CFS scheduler below */
+	struct rb_tree timeline;
+	unsigned long long min_vruntime;
+	unsigned long long load;	/* Sum of the weights of the ready ones */
+	unsigned int nr_ready;
+};
+
+static __thread struct ready_index ready_indexes[MAX_NR_CPUS];
+static __thread bool prio_rq_enabled = false;
+static __thread bool ready_aging = false;
+static __thread bool cfs_enabled = false;
+static __thread bool mlfq_enabled = false;
+static __thread unsigned int mlfq_boosts = 0;
+
+static inline struct ready_index *__this_index(void)
+{
+	return ready_indexes + this_cpu;
+}
 
+/* Level of @p in MLFQ. It is back to the top once boosted */
+static inline unsigned int __mlfq_level(struct process *p)
+{
+	return p->mlfq_boosts == mlfq_boosts ? p->mlfq_level : 0;
+}
 
 /**
- * Quiet mode. True if the program was started with -q option
+ * Level of @p in @prio_rq. The top level also holds the ones above it.
+ * MLFQ puts its levels from the top below MAX_PRIO
  */
-extern bool quiet;
+static inline int __level(struct process *p)
+{
+	if (mlfq_enabled) return MAX_PRIO - 1 - __mlfq_level(p);
+	return p->prio < MAX_PRIO ? p->prio : MAX_PRIO;
+}
+
+/**
+ * Weights of the processes in CFS by their priority, which are the ones of
+ * Linux from nice 0 (prio 0) down to nice -20 (prio MAX_PRIO and above).
+ * A process gets the CPU time in proportion to its weight.
+ */
+#define CFS_NICE_0_WEIGHT		1024
+#define CFS_VRUNTIME_SCALE		65536	/* vruntime of a tick at nice 0 */
+
+static const unsigned int cfs_weights[] = {
+	 1024,  1277,  1586,  1991,  2501,  3121,  3906,  4904,  6100,  7620,
+	 9548, 11916, 14949, 18705, 23254, 29154, 36291, 46273, 56483, 71755,
+	88761,
+};
+
+static inline unsigned int __cfs_weight(struct process *p)
+{
+	return cfs_weights[__level(p) * 20 / MAX_PRIO];
+}
+
+/* vruntime that @p gains by running a tick */
+static inline unsigned long long __cfs_vdelta(struct process *p)
+{
+	return (unsigned long long)CFS_NICE_0_WEIGHT * CFS_VRUNTIME_SCALE / __cfs_weight(p);
+}
+
+/* Smaller vruntime first, in the ready queue order */
+static bool __earlier_vruntime(const struct rb_node *a, const struct rb_node *b)
+{
+	struct process *pa = container_of(a, struct process, rq_rb);
+	struct process *pb = container_of(b, struct process, rq_rb);
+
+	if (pa->vruntime != pb->vruntime) return pa->vruntime < pb->vruntime;
+	return pa->rq_seq < pb->rq_seq;
+}
+
+/* Charge @p for the ticks it has run since the last time */
+static void __cfs_charge(struct process *p)
+{
+	p->vruntime += (p->age - p->rq_age) * __cfs_vdelta(p);
+	p->rq_age = p->age;
+}
+
+static void __cfs_update_min_vruntime(struct process *curr);
+
+static void __cfs_enqueue(struct ready_index *ri, struct process *p)
+{
+	/* Bring @min_vruntime up to date with the running one first */
+	if (current && current != p && current->status == PROCESS_RUNNING) {
+		__cfs_charge(current);
+		__cfs_update_min_vruntime(current);
+	}
+
+	/* Do not let a new or woken up one catch up with the others for long */
+	if (p->vruntime < ri->min_vruntime) p->vruntime = ri->min_vruntime;
+
+	rb_insert(&ri->timeline, &p->rq_rb);
+	ri->load += __cfs_weight(p);
+}
+
+static void __cfs_dequeue(struct ready_index *ri, struct process *p)
+{
+	rb_erase(&ri->timeline, &p->rq_rb);
+	ri->load -= __cfs_weight(p);
+}
+
+static void __ready_index(struct process *p, bool head)
+{
+	struct ready_index *ri = __this_index();
+
+	p->rq_cpu = this_cpu;
+	p->rq_epoch = ri->epoch;
+	ri->nr_ready++;
+
+	if (ri->heap.before && heap_push(&ri->heap, &p->rq_node)) {
+		/* It would never be picked. Do not go on without it */
+		fprintf(stderr, "Unable to put process %d into the ready queue\n", p->pid);
+		close_event_log();
+		exit(EXIT_FAILURE);
+	}
+	if (prio_rq_enabled) prio_array_add(&ri->prio_rq, &p->rq_list, __level(p), head);
+	if (cfs_enabled) __cfs_enqueue(ri, p);
+}
+
+static void __ready_enqueue(struct process *p, bool head)
+{
+	struct ready_index *ri = __this_index();
+
+	if (head) {
+		list_move(&p->list, &readyqueue);
+		p->rq_seq = --ri->head_seq;
+	} else {
+		list_move_tail(&p->list, &readyqueue);
+		p->rq_seq = ++ri->tail_seq;
+	}
+
+	__ready_index(p, head);
+}
+
+static void __ready_dequeue(struct process *p)
+{
+	struct ready_index *ri = ready_indexes + p->rq_cpu;
+
+	list_del_init(&p->list);
+	ri->nr_ready--;
+
+	if (ready_aging) p->prio += ri->epoch - p->rq_epoch;
+	if (heap_queued(&p->rq_node)) heap_remove(&ri->heap, &p->rq_node);
+	if (!list_empty(&p->rq_list)) prio_array_del(&ri->prio_rq, &p->rq_list, __level(p));
+	if (rb_queued(&p->rq_rb)) __cfs_dequeue(ri, p);
+}
+
+static inline struct process *__ready_peek(void)
+{
+	struct heap_node *node = heap_peek(&__this_index()->heap);
+
+	return node ? container_of(node, struct process, rq_node) : NULL;
+}
+
+/* The framework put @p at the tail of @readyqueue on fork or migration. Index it */
+static void __ready_forked(struct process *p)
+{
+	p->rq_seq = ++__this_index()->tail_seq;
+	__ready_index(p, false);
+}
+
+static unsigned int __ready_count(unsigned int cpu)
+{
+	return ready_indexes[cpu].nr_ready;
+}
+
+static int __ready_initialize(bool (*before)(const struct heap_node *, const struct heap_node *))
+{
+	for (int cpu = 0; cpu < MAX_NR_CPUS; cpu++) {
+		struct ready_index *ri = ready_indexes + cpu;
+
+		heap_init(&ri->heap, before);
+		prio_array_init(&ri->prio_rq);
+		ri->head_seq = ri->tail_seq = 0;
+		ri->epoch = 0;
+
+		rb_init(&ri->timeline, __earlier_vruntime);
+		ri->min_vruntime = 0;
+		ri->load = 0;
+		ri->nr_ready = 0;
+	}
+	prio_rq_enabled = (before == NULL);
+	return 0;
+}
+
+static void __ready_finalize(void)
+{
+	for (int cpu = 0; cpu < MAX_NR_CPUS; cpu++) {
+		heap_destroy(&ready_indexes[cpu].heap);
+		ready_indexes[cpu].heap.before = NULL;
+		ready_indexes[cpu].nr_ready = 0;
+	}
+	prio_rq_enabled = false;
+	ready_aging = false;
+	cfs_enabled = false;
+	mlfq_enabled = false;
+}
+
+/* All the ready processes of this CPU get older by one */
+static inline void __ready_age(void)
+{
+	__this_index()->epoch++;
+}
+
+/**
+ * Put @p into @level of @prio_rq at the position its ready queue order says.
+ * Used when @p changes the level while it is queued, which is rare.
+ */
+static void __prio_rq_insert_ordered(struct process *p, int level)
+{
+	struct prio_array *prio_rq = &ready_indexes[p->rq_cpu].prio_rq;
+	struct list_head *queue = prio_rq->queues + level;
+	struct list_head *pos;
+
+	for (pos = queue->prev; pos != queue; pos = pos->prev) {
+		if (list_entry(pos, struct process, rq_list)->rq_seq < p->rq_seq) break;
+	}
+	list_add(&p->rq_list, pos);
+	__prio_array_mark(prio_rq, level);
+}
+
+/* Change the priority of @p in the ready queue to @prio */
+static void __ready_reprio(struct process *p, unsigned int prio)
+{
+	prio_array_del(&ready_indexes[p->rq_cpu].prio_rq, &p->rq_list, __level(p));
+	p->prio = prio;
+	__prio_rq_insert_ordered(p, __level(p));
+}
+
+/**
+ * Pick the highest one that comes first in the ready queue, or the last one
+ * if @lifo. A level holds the processes in the ready queue order, so it is
+ * at either end of the level except for the top level. The top level may
+ * hold different priorities above MAX_PRIO; look into it then.
+ */
+static struct process *__prio_rq_pick(bool lifo)
+{
+	struct prio_array *prio_rq = &__this_index()->prio_rq;
+	int level = prio_array_highest(prio_rq);
+	struct list_head *queue;
+	struct process *p, *next = NULL;
+
+	if (level < 0) return NULL;
+
+	queue = prio_rq->queues + level;
+	if (level < MAX_PRIO) {
+		return lifo ? list_last_entry(queue, struct process, rq_list) :
+				list_first_entry(queue, struct process, rq_list);
+	}
+
+	list_for_each_entry(p, queue, rq_list) {
+		if (!next || p->prio > next->prio || (lifo && p->prio == next->prio)) {
+			next = p;
+		}
+	}
+	return next;
+}
+
+#define __rq_entry(node)	container_of(node, struct process, rq_node)
+
+/* Higher priority including the aging so far, in the ready queue order */
+static bool __higher_aged_prio(const struct heap_node *a, const struct heap_node *b)
+{
+	struct process *pa = __rq_entry(a), *pb = __rq_entry(b);
+	long long prio_a = (long long)pa->prio - pa->rq_epoch;
+	long long prio_b = (long long)pb->prio - pb->rq_epoch;
+
+	if (prio_a != prio_b) return prio_a > prio_b;
+	return pa->rq_seq < pb->rq_seq;
+}
+
+/* Shorter lifespan first, in the ready queue order */
+static bool __shorter_job(const struct heap_node *a, const struct heap_node *b)
+{
+	struct process *pa = __rq_entry(a), *pb = __rq_entry(b);
+
+	if (pa->lifespan != pb->lifespan) return pa->lifespan < pb->lifespan;
+	return pa->rq_seq < pb->rq_seq;
+}
+
+/* The ones without deadline or period come after all the others */
+static inline unsigned int __deadline_of(struct process *p)
+{
+	return p->deadline ? p->deadline : UINT_MAX;
+}
+
+static inline unsigned int __period_of(struct process *p)
+{
+	return p->period ? p->period : UINT_MAX;
+}
+
+/* Earlier deadline first, in the ready queue order */
+static bool __earlier_deadline(const struct heap_node *a, const struct heap_node *b)
+{
+	struct process *pa = __rq_entry(a), *pb = __rq_entry(b);
+
+	if (__deadline_of(pa) != __deadline_of(pb)) return __deadline_of(pa) < __deadline_of(pb);
+	return pa->rq_seq < pb->rq_seq;
+}
+
+/* Shorter period first, in the ready queue order */
+static bool __shorter_period(const struct heap_node *a, const struct heap_node *b)
+{
+	struct process *pa = __rq_entry(a), *pb = __rq_entry(b);
+
+	if (__period_of(pa) != __period_of(pb)) return __period_of(pa) < __period_of(pb);
+	return pa->rq_seq < pb->rq_seq;
+}
+
 
 
 /***********************************************************************
@@ -145,7 +489,7 @@ void fcfs_release(int resource_id)
 		 * Put the waiter process into ready queue. The framework will
 		 * do the rest.
 		 */
-		list_add_tail(&waiter->list, &readyqueue);
+		__ready_enqueue(waiter, false);
 	}
 }
 
@@ -205,13 +549,19 @@ pick_next:
 		 * instead of list_del() to maintain the list head tidy. Otherwise,
 		 * the framework will complain (assert) on process exit.
 		 */
-		list_del_init(&next->list);
+		__ready_dequeue(next);
 	}
 
 	/* Return the next process to run */
 	return next;
 }
 
+/* Non-preemptive. @current runs to the end once it is picked */
+static unsigned int fifo_next_decision(void)
+{
+	return current->lifespan - current->age;
+}
+
 struct scheduler fifo_scheduler = {
 	.name = "FIFO",
 	.acquire = fcfs_acquire,
@@ -219,6 +569,11 @@ struct scheduler fifo_scheduler = {
 	.initialize = fifo_initialize,
 	.finalize = fifo_finalize,
 	.schedule = fifo_schedule,
+	.next_decision = fifo_next_decision,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 };
 
 
@@ -247,43 +602,34 @@ pick_next:
     /* Let's pick a new process to run next */
 
     if (!list_empty(&readyqueue)) {
-
-        /**
-                * list_for_each_entry_safe - iterate over list of given type safe against removal of list entry
-        * @pos:	the type * to use as a loop cursor.
-        * @n:		another type * to use as temporary storage
-        * @head:	the head for your list.
-        * @member:	the name of the list_head within the struct.
-        */
-
-        struct process *pos = NULL;
-        struct process *n = NULL;
-        struct process *temp = NULL;
-
-        list_for_each_entry_safe(pos,n,&readyqueue,list) {
-            if(temp == NULL) {
-                temp = pos;
-            }
-            else if ( temp != NULL && temp->lifespan > pos->lifespan) {
-                temp = pos;
-            }
-        }
-
-        next = temp;
-        list_del_init(&next->list);
+        /* The shortest one that came first */
+        next = __ready_peek();
+        __ready_dequeue(next);
     }
 
     /* Return the next process to run */
     return next;
 }
 
+static int sjf_initialize(void)
+{
+	return __ready_initialize(__shorter_job);
+}
+
 struct scheduler sjf_scheduler = {
 	.name = "Shortest-Job First",
 	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
 	.release = fcfs_release, /* Use the default FCFS release() */
+	.initialize = sjf_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 	.schedule = sjf_schedule,		 /* TODO: Assign sjf_schedule()
 								to this function pointer to activate
 								SJF in the system */
+	.next_decision = fifo_next_decision, /* Non-preemptive as FIFO */
 };
 
 
@@ -305,7 +651,7 @@ static struct process *srtf_schedule(void)
 
     /* The current process has remaining lifetime. Schedule it again */
     if (current->age < current->lifespan) {
-        list_move(&current->list, &readyqueue);
+        __ready_enqueue(current, true);
         goto pick_next; // return x
     }
 
@@ -313,26 +659,14 @@ pick_next:
     /* Let's pick a new process to run next */
 
     if (!list_empty(&readyqueue)) {
-
-        struct process *pos = NULL;
-        struct process *n = NULL;
-        struct process *temp = NULL;
-
-        list_for_each_entry_safe(pos,n,&readyqueue,list) {
-            if(temp == NULL) {
-                temp = pos;
-            }
-            else if ( temp != NULL && temp->lifespan > pos->lifespan) {
-                temp = pos;
-            }
-        }
-        next = temp;
+        /* The current one wins the ties as it is put at the head */
+        next = __ready_peek();
         /**
          * Detach the process from the ready queue. Note we use list_del_init()
          * instead of list_del() to maintain the list head tidy. Otherwise,
          * the framework will complain (assert) on process exit.
          */
-        list_del_init(&next->list);
+        __ready_dequeue(next);
     }
 
     /* Return the next process to run */
@@ -342,6 +676,12 @@ struct scheduler srtf_scheduler = {
 	.name = "Shortest Remaining Time First",
 	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
 	.release = fcfs_release, /* Use the default FCFS release() */
+	.initialize = sjf_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 	.schedule = srtf_schedule,
 	/* You need to check the newly created processes to implement SRTF.
 	 * You may use @forked() callback to mark newly created processes */
@@ -367,7 +707,7 @@ static struct process *rr_schedule(void)
 
     /* The current process has remaining lifetime. Schedule it again */
     if (current->age < current->lifespan) {
-        list_move_tail(&current->list, &readyqueue);
+        __ready_enqueue(current, false);
         goto pick_next;
     }
 
@@ -381,7 +721,7 @@ pick_next:
          * instead of list_del() to maintain the list head tidy. Otherwise,
          * the framework will complain (assert) on process exit.
          */
-        list_del_init(&next->list);
+        __ready_dequeue(next);
     }
 
     /* Return the next process to run */
@@ -393,6 +733,10 @@ struct scheduler rr_scheduler = {
 	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
 	.release = fcfs_release, /* Use the default FCFS release() */
 	.schedule = rr_schedule,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 	/* Obviously, you should implement rr_schedule() and attach it here */
 };
 
@@ -415,7 +759,6 @@ static int prio_initialize(void)
 
     struct process *pos = NULL;
     struct process *n = NULL;
-    struct process *temp = NULL;
 
     list_for_each_entry_safe(pos,n,&readyqueue,list) {
         pos->prio_orig = pos->prio;
@@ -443,7 +786,12 @@ bool prio_acquire(int resource_id)
 
     if (boostingType.pip == true){
         if(current -> prio > r->owner->prio){
-            r->owner->prio = current->prio;
+            if (!list_empty(&r->owner->rq_list)) {
+                /* The owner is ready. Move it to the new level */
+                __ready_reprio(r->owner, current->prio);
+            } else {
+                r->owner->prio = current->prio;
+            }
         }
     }
 
@@ -490,7 +838,7 @@ void prio_release(int resource_id)
         list_for_each_entry_safe(waiter, n, &r->waitqueue,list) {
             list_del_init(&waiter->list);
             waiter->status = PROCESS_READY;
-            list_move(&waiter->list, &readyqueue);
+            __ready_enqueue(waiter, true);
             list_del_init(&current->list);
         }
 
@@ -516,7 +864,7 @@ static struct process *prio_schedule(void)
 
     /* The current process has remaining lifetime. Schedule it again */
     if (current->age < current->lifespan) {
-        list_move(&current->list, &readyqueue);
+        __ready_enqueue(current, true);
         goto pick_next;
     }
 
@@ -524,36 +872,36 @@ pick_next:
     /* Let's pick a new process to run next */
 
     if (!list_empty(&readyqueue)) {
-
-        struct process *pos = NULL;
-        struct process *n = NULL;
-        struct process *temp = NULL;
-
-        list_for_each_entry_safe(pos,n,&readyqueue,list) {
-            if(temp == NULL) {
-                temp = pos;
-            }
-            else if ( temp != NULL && temp->prio < pos->prio) {
-                temp = pos;
-            }
-        }
-        next = temp;
+        /* The highest one that comes first in the ready queue */
+        next = __prio_rq_pick(false);
         /**
          * Detach the process from the ready queue. Note we use list_del_init()
          * instead of list_del() to maintain the list head tidy. Otherwise,
          * the framework will complain (assert) on process exit.
          */
-        list_del_init(&next->list);
+        __ready_dequeue(next);
     }
 
     /* Return the next process to run */
     return next;
 }
+
+static int prio_ready_initialize(void)
+{
+    __ready_initialize(NULL);
+    return prio_initialize();
+}
+
 struct scheduler prio_scheduler = {
 	.name = "Priority",
 	.acquire = prio_acquire,
 	.release = prio_release,
-	.initialize = prio_initialize,
+	.initialize = prio_ready_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 	.schedule = prio_schedule,
 	/**
 	 * Implement your own acqure/release function to make priority
@@ -582,7 +930,7 @@ static struct process *pa_schedule(void)
 
     /* The current process has remaining lifetime. Schedule it again */
     if (current->age < current->lifespan) {
-        list_move_tail(&current->list, &readyqueue);
+        __ready_enqueue(current, false);
         goto pick_next;
     }
 
@@ -591,31 +939,17 @@ pick_next:
 
     if (!list_empty(&readyqueue)) {
 
-        struct process *pos = NULL;
-        struct process *n = NULL;
-        struct process *temp = NULL;
-
-
-        list_for_each_entry_safe(pos,n,&readyqueue,list) {
-            if(temp == NULL) {
-                temp = pos;
-            }
-            else if ( temp != NULL && temp->prio < pos->prio) {
-                temp = pos;
-            }
-        }
-        next = temp;
-        next->prio = next->prio_orig;
+        next = __ready_peek();
         /**
          * Detach the process from the ready queue. Note we use list_del_init()
          * instead of list_del() to maintain the list head tidy. Otherwise,
          * the framework will complain (assert) on process exit.
          */
-        list_del_init(&next->list);
+        __ready_dequeue(next);
+        next->prio = next->prio_orig;
 
-        list_for_each_entry_safe(pos,n,&readyqueue,list) {
-            pos->prio +=1;
-        }
+        /* The others get older */
+        __ready_age();
 
         /** for Test **/
         /*
@@ -655,13 +989,25 @@ pick_next:
     return next;
 }
 
+static int pa_initialize(void)
+{
+    __ready_initialize(__higher_aged_prio);
+    ready_aging = true;
+    return prio_initialize();
+}
+
 struct scheduler pa_scheduler = {
         /* Implement your own pa_schedule() and attach it here */
 
 	.name = "Priority + aging",
 	.acquire = prio_acquire,
 	.release = prio_release,
-	.initialize = prio_initialize,
+	.initialize = pa_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 	.schedule = pa_schedule,
 	/**
 	 * Implement your own acqure/release function to make priority
@@ -693,7 +1039,7 @@ static struct process *pcp_schedule(void)
 
     /* The current process has remaining lifetime. Schedule it again */
     if (current->age < current->lifespan) {
-        list_move(&current->list, &readyqueue);
+        __ready_enqueue(current, true);
         goto pick_next;
     }
 
@@ -701,37 +1047,38 @@ static struct process *pcp_schedule(void)
     /* Let's pick a new process to run next */
 
     if (!list_empty(&readyqueue)) {
-
-        struct process *pos = NULL;
-        struct process *n = NULL;
-        struct process *temp = NULL;
-
-        list_for_each_entry_safe(pos,n,&readyqueue,list) {
-            if(temp == NULL) {
-                temp = pos;
-            }
-            else if ( temp != NULL && temp->prio <= pos->prio && first == false) {
-                temp = pos;
-            }
+        /**
+         * The highest one that comes last in the ready queue, except for the
+         * very first pick which takes the head
+         */
+        if (first) {
+            next = list_first_entry(&readyqueue, struct process, list);
+        } else {
+            next = __prio_rq_pick(true);
         }
-        next = temp;
         /**
          * Detach the process from the ready queue. Note we use list_del_init()
          * instead of list_del() to maintain the list head tidy. Otherwise,
          * the framework will complain (assert) on process exit.
          */
-        list_del_init(&next->list);
+        __ready_dequeue(next);
     }
 
     /* Return the next process to run */
     first= false;
     return next;
 }
+
 struct scheduler pcp_scheduler = {
 	.name = "Priority + PCP Protocol",
 	.acquire = prio_acquire,
 	.release = prio_release,
-	.initialize = prio_initialize,
+	.initialize = prio_ready_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 	.schedule = pcp_schedule,
 	/**
 	 * Implement your own acqure/release function too to make priority
@@ -763,7 +1110,7 @@ static struct process *pip_schedule(void)
 
     /* The current process has remaining lifetime. Schedule it again */
     if (current->age < current->lifespan) {
-        list_move(&current->list, &readyqueue);
+        __ready_enqueue(current, true);
         goto pick_next;
     }
 
@@ -771,40 +1118,21 @@ static struct process *pip_schedule(void)
     /* Let's pick a new process to run next */
 
     if (!list_empty(&readyqueue)) {
-
-        struct process *pos = NULL;
-        struct process *n = NULL;
-        struct process *temp = NULL;
-
-        list_for_each_entry_safe(pos,n,&readyqueue,list) {
-            if(temp == NULL) {
-                temp = pos;
-            }
-            else if ( temp != NULL && temp->prio < pos->prio && first == false) {
-                temp = pos;
-            }
-            /** for Test **/
-
-//            if (pos->pid == 1) {
-//                printf("\n current Num: %d, \tPrio: %d in tick: %d \n",pos->pid, pos->prio, ticks);
-//            }
-//            if (pos->pid == 2) {
-//                printf("\n current Num: %d, \tPrio: %d in tick: %d \n",pos->pid, pos->prio, ticks);
-//            }
-//            if (pos->pid == 3) {
-//                printf("\n current Num: %d, \tPrio: %d in tick: %d \n",pos->pid, pos->prio, ticks);
-//            }
-//            if (pos->pid == 4) {
-//                printf("\n current Num: %d, \tPrio: %d in tick: %d \n",pos->pid, pos->prio, ticks);
-//            }
+        /**
+         * The highest one that comes first in the ready queue, except for
+         * the very first pick which takes the head
+         */
+        if (first) {
+            next = list_first_entry(&readyqueue, struct process, list);
+        } else {
+            next = __prio_rq_pick(false);
         }
-        next = temp;
         /**
          * Detach the process from the ready queue. Note we use list_del_init()
          * instead of list_del() to maintain the list head tidy. Otherwise,
          * the framework will complain (assert) on process exit.
          */
-        list_del_init(&next->list);
+        __ready_dequeue(next);
 
     }
 
@@ -817,9 +1145,389 @@ struct scheduler pip_scheduler = {
 	.name = "Priority + PIP Protocol",
 	.acquire = prio_acquire,
 	.release = prio_release,
-	.initialize = prio_initialize,
+	.initialize = prio_ready_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
 	.schedule = pip_schedule,
 	/**
 	 * Ditto
 	 */
 };
+
+
+/***********************************************************************
+ * CFS scheduler
+ *
+ * DESCRIPTION
+ *   Completely fair scheduler. Each process accumulates its runtime,
+ *   weighted by its priority, in @vruntime, and the ready one with the
+ *   smallest @vruntime runs next. The ready processes are sorted by
+ *   @vruntime in @timeline.
+ *
+ *   The ready processes share @cfs_latency ticks in proportion to their
+ *   weights, but each gets @cfs_min_granularity ticks at least. The
+ *   current one runs for its share unless a ready one lags far behind
+ *   after running for the granularity. @min_vruntime follows the
+ *   smallest @vruntime monotonically, and new, woken up, and migrated
+ *   processes start from there.
+ ***********************************************************************/
+static inline struct process *__cfs_first(void)
+{
+	struct rb_node *node = rb_first(&__this_index()->timeline);
+
+	return node ? container_of(node, struct process, rq_rb) : NULL;
+}
+
+/* Ticks that @p is entitled to run for at a time */
+static unsigned int __cfs_slice(struct process *p)
+{
+	struct ready_index *ri = __this_index();
+	unsigned int nr_running = ri->nr_ready + 1;
+	unsigned long long load = ri->load + __cfs_weight(p);
+	unsigned int period = cfs_latency;
+	unsigned int slice;
+
+	/* Stretch the period not to slice it thinner than the granularity */
+	if (nr_running > cfs_latency / cfs_min_granularity) {
+		period = nr_running * cfs_min_granularity;
+	}
+
+	slice = (unsigned long long)period * __cfs_weight(p) / load;
+	return slice > cfs_min_granularity ? slice : cfs_min_granularity;
+}
+
+static void __cfs_update_min_vruntime(struct process *curr)
+{
+	struct ready_index *ri = __this_index();
+	struct process *first = __cfs_first();
+	unsigned long long vruntime;
+
+	if (curr) {
+		vruntime = curr->vruntime;
+		if (first && first->vruntime < vruntime) vruntime = first->vruntime;
+	} else if (first) {
+		vruntime = first->vruntime;
+	} else {
+		return;
+	}
+
+	if (vruntime > ri->min_vruntime) ri->min_vruntime = vruntime;
+}
+
+/* Should @curr, which has made progress, give the CPU to the first one? */
+static bool __cfs_preempt(struct process *curr)
+{
+	struct process *first = __cfs_first();
+	unsigned int ran = curr->age - curr->slice_start;
+	unsigned int slice;
+
+	if (!first) return false;
+
+	slice = __cfs_slice(curr);
+	if (ran >= slice) return true;
+	if (ran < cfs_min_granularity) return false;
+
+	return curr->vruntime > first->vruntime + (unsigned long long)slice * CFS_VRUNTIME_SCALE;
+}
+
+static struct process *cfs_schedule(void)
+{
+	struct process *next = NULL;
+
+	if (!current || current->status == PROCESS_WAIT) {
+		goto pick_next;
+	}
+
+	if (current->age < current->lifespan) {
+		__cfs_charge(current);
+
+		if (!__cfs_preempt(current)) {
+			__cfs_update_min_vruntime(current);
+			return current;
+		}
+		__ready_enqueue(current, false);
+	}
+
+pick_next:
+	next = __cfs_first();
+	if (next) {
+		__ready_dequeue(next);
+		next->slice_start = next->age;
+	}
+	__cfs_update_min_vruntime(next);
+
+	return next;
+}
+
+/* No one preempts the current before it runs for the granularity */
+static unsigned int cfs_next_decision(void)
+{
+	unsigned int left = current->lifespan - current->age;
+	unsigned int ran = current->age - current->slice_start;
+	unsigned int safe;
+
+	if (list_empty(&readyqueue)) return left;
+
+	safe = __cfs_slice(current);
+	if (safe > cfs_min_granularity) safe = cfs_min_granularity;
+
+	safe = safe > ran ? safe - ran : 0;
+	return safe < left ? safe : left;
+}
+
+/* Keep @vruntime relative to @min_vruntime while moving between CPUs */
+static void cfs_migrating(struct process *p)
+{
+	__ready_dequeue(p);
+	p->vruntime -= ready_indexes[p->rq_cpu].min_vruntime;
+}
+
+static void cfs_migrated(struct process *p)
+{
+	p->vruntime += __this_index()->min_vruntime;
+	__ready_forked(p);
+}
+
+static int cfs_initialize(void)
+{
+	/* Index the ready processes in @timeline only */
+	__ready_initialize(NULL);
+	prio_rq_enabled = false;
+	cfs_enabled = true;
+	return 0;
+}
+
+struct scheduler cfs_scheduler = {
+	.name = "CFS",
+	.acquire = fcfs_acquire,
+	.release = fcfs_release,
+	.initialize = cfs_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = cfs_migrating,
+	.migrated = cfs_migrated,
+	.nr_ready = __ready_count,
+	.schedule = cfs_schedule,
+	.next_decision = cfs_next_decision,
+};
+
+
+/***********************************************************************
+ * EDF and RM schedulers
+ *
+ * DESCRIPTION
+ *   Real-time schedulers for the processes with deadlines. EDF runs the
+ *   ready process with the earliest deadline, and RM the one with the
+ *   shortest period, which is its static priority. Both preempt the current
+ *   one as soon as a more urgent one gets ready, and keep it on ties. The
+ *   processes with no deadline (or period for RM) run when no others are
+ *   ready, in the ready queue order.
+ *
+ *   A process gets ready only when it is forked or woken up, and the
+ *   framework stops running @current in bursts there. So they are asked to
+ *   decide only at those moments as FIFO is.
+ ***********************************************************************/
+static struct process *rt_schedule(void)
+{
+	struct process *next = NULL;
+
+	if (!current || current->status == PROCESS_WAIT) {
+		goto pick_next;
+	}
+
+	/* The current one wins the ties as it is put at the head */
+	if (current->age < current->lifespan) {
+		__ready_enqueue(current, true);
+	}
+
+pick_next:
+	if (!list_empty(&readyqueue)) {
+		next = __ready_peek();
+		__ready_dequeue(next);
+	}
+
+	return next;
+}
+
+static int edf_initialize(void)
+{
+	return __ready_initialize(__earlier_deadline);
+}
+
+static int rm_initialize(void)
+{
+	return __ready_initialize(__shorter_period);
+}
+
+struct scheduler edf_scheduler = {
+	.name = "Earliest Deadline First",
+	.acquire = fcfs_acquire,
+	.release = fcfs_release,
+	.initialize = edf_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
+	.schedule = rt_schedule,
+	.next_decision = fifo_next_decision,
+};
+
+struct scheduler rm_scheduler = {
+	.name = "Rate Monotonic",
+	.acquire = fcfs_acquire,
+	.release = fcfs_release,
+	.initialize = rm_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
+	.schedule = rt_schedule,
+	.next_decision = fifo_next_decision,
+};
+
+
+/***********************************************************************
+ * MLFQ scheduler
+ *
+ * DESCRIPTION
+ *   Multi-level feedback queue. There are @mlfq_levels FIFO queues, and
+ *   the ready process in the highest non-empty one runs. A process starts
+ *   at the top level, and moves down a level once it runs for the quantum
+ *   of its level there, which it cannot avoid by getting blocked in the
+ *   middle. So the short and interactive ones stay above the long ones.
+ *   A process that gets ready in a higher level preempts the current one,
+ *   which keeps the rest of its quantum at the head of its level.
+ *
+ *   Every @mlfq_boost_period ticks, all the processes are boosted back to
+ *   the top so that the ones at the bottom do not starve. The queues are
+ *   spliced into the top one, and the others are brought there lazily by
+ *   counting the boosts in @mlfq_boosts.
+ *
+ *   The levels are the ones of @prio_rq from MAX_PRIO - 1 down, so the
+ *   next one is found through its bitmap in O(1).
+ ***********************************************************************/
+static __thread unsigned int mlfq_next_boost;
+
+static inline unsigned int __mlfq_index(unsigned int level)
+{
+	return MAX_PRIO - 1 - level;
+}
+
+/* Bring the level of @p up to date with the boosts */
+static void __mlfq_sync(struct process *p)
+{
+	if (p->mlfq_boosts == mlfq_boosts) return;
+
+	p->mlfq_level = 0;
+	p->mlfq_used = 0;
+	p->mlfq_boosts = mlfq_boosts;
+}
+
+/* Charge @p for the ticks it has run since the last time */
+static void __mlfq_charge(struct process *p)
+{
+	__mlfq_sync(p);
+	p->mlfq_used += p->age - p->rq_age;
+	p->rq_age = p->age;
+}
+
+static void __mlfq_set_next_boost(void)
+{
+	mlfq_next_boost = mlfq_boost_period ?
+			(ticks / mlfq_boost_period + 1) * mlfq_boost_period : UINT_MAX;
+}
+
+static void __mlfq_boost(void)
+{
+	mlfq_boosts++;
+	__mlfq_set_next_boost();
+
+	for (int cpu = 0; cpu < MAX_NR_CPUS; cpu++) {
+		struct prio_array *prio_rq = &ready_indexes[cpu].prio_rq;
+		struct list_head *top = prio_rq->queues + __mlfq_index(0);
+
+		if (!prio_rq->bitmap) continue;
+
+		for (unsigned int level = 1; level < mlfq_levels; level++) {
+			list_splice_tail_init(prio_rq->queues + __mlfq_index(level), top);
+			__prio_array_sync(prio_rq, __mlfq_index(level));
+		}
+		__prio_array_mark(prio_rq, __mlfq_index(0));
+	}
+}
+
+static struct process *mlfq_schedule(void)
+{
+	struct process *next = NULL;
+
+	if (current) __mlfq_charge(current);
+	if (ticks >= mlfq_next_boost) __mlfq_boost();
+
+	if (!current || current->status == PROCESS_WAIT) {
+		goto pick_next;
+	}
+
+	if (current->age < current->lifespan) {
+		/* current is charged before the boost. Catch up with it */
+		__mlfq_sync(current);
+
+		if (current->mlfq_used >= mlfq_quanta[current->mlfq_level]) {
+			/* Used up the quantum. Move down to the tail of the next level */
+			if (current->mlfq_level < mlfq_levels - 1) current->mlfq_level++;
+			current->mlfq_used = 0;
+			__ready_enqueue(current, false);
+		} else {
+			/* Run on unless a higher one is ready */
+			__ready_enqueue(current, true);
+		}
+	}
+
+pick_next:
+	next = __prio_rq_pick(false);
+	if (next) {
+		__ready_dequeue(next);
+		__mlfq_sync(next);
+	}
+
+	return next;
+}
+
+/* Nothing but forks and wake-ups preempts before the quantum or the boost */
+static unsigned int mlfq_next_decision(void)
+{
+	unsigned int left = current->lifespan - current->age;
+	unsigned int quantum = mlfq_quanta[current->mlfq_level] - current->mlfq_used -
+			(current->age - current->rq_age);
+	unsigned int boost = mlfq_next_boost - ticks - 1;
+
+	if (quantum < left) left = quantum;
+	return boost < left ? boost : left;
+}
+
+static int mlfq_initialize(void)
+{
+	__ready_initialize(NULL);
+	mlfq_enabled = true;
+	mlfq_boosts = 0;
+	__mlfq_set_next_boost();
+	return 0;
+}
+
+struct scheduler mlfq_scheduler = {
+	.name = "MLFQ",
+	.acquire = fcfs_acquire,
+	.release = fcfs_release,
+	.initialize = mlfq_initialize,
+	.finalize = __ready_finalize,
+	.forked = __ready_forked,
+	.migrating = __ready_dequeue,
+	.migrated = __ready_forked,
+	.nr_ready = __ready_count,
+	.schedule = mlfq_schedule,
+	.next_decision = mlfq_next_decision,
+};
@@ -0,0 +1,87 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __PRIO_ARRAY_H__
+#define __PRIO_ARRAY_H__
+
+/**
+ * O(1) priority array in the way the O(1) scheduler of Linux has; a FIFO
+ * list per priority level and a bitmap telling which levels are occupied.
+ * The highest occupied level is found with a single count-leading-zeros.
+ *
+ * Priorities range from 0 to MAX_PRIO, that is, MAX_PRIO + 1 levels. The
+ * bitmap covers the levels below MAX_PRIO, and the top level is checked
+ * separately.
+ */
+#if MAX_PRIO != 64
+#error "struct prio_array assumes a 64-bit bitmap for the levels below MAX_PRIO"
+#endif
+
+#define NR_PRIO_LEVELS	(MAX_PRIO + 1)
+
+struct prio_array {
+	unsigned long long bitmap;	/* Bit n is set if @queues[n] is not empty */
+	struct list_head queues[NR_PRIO_LEVELS];
+};
+
+static inline void prio_array_init(struct prio_array *array)
+{
+	array->bitmap = 0;
+	for (int i = 0; i < NR_PRIO_LEVELS; i++) {
+		INIT_LIST_HEAD(array->queues + i);
+	}
+}
+
+static inline void __prio_array_mark(struct prio_array *array, int level)
+{
+	if (level < MAX_PRIO) array->bitmap |= 1ULL << level;
+}
+
+/* Update the bit for @level after something is taken out of it */
+static inline void __prio_array_sync(struct prio_array *array, int level)
+{
+	if (level < MAX_PRIO && list_empty(array->queues + level)) {
+		array->bitmap &= ~(1ULL << level);
+	}
+}
+
+static inline void prio_array_add(struct prio_array *array,
+		struct list_head *entry, int level, bool head)
+{
+	if (head) {
+		list_add(entry, array->queues + level);
+	} else {
+		list_add_tail(entry, array->queues + level);
+	}
+	__prio_array_mark(array, level);
+}
+
+static inline void prio_array_del(struct prio_array *array,
+		struct list_head *entry, int level)
+{
+	list_del_init(entry);
+	__prio_array_sync(array, level);
+}
+
+/* Return the highest occupied level, or -1 if @array is empty */
+static inline int prio_array_highest(const struct prio_array *array)
+{
+	if (!list_empty(array->queues + MAX_PRIO)) return MAX_PRIO;
+	if (!array->bitmap) return -1;
+
+	return 63 - __builtin_clzll(array->bitmap);
+}
+
+#endif
@@ -16,6 +16,9 @@
 #ifndef __PROCESS_H__
 #define __PROCESS_H__
 
+#include "heap.h"
+#include "rbtree.h"
+
 struct list_head;
 
 enum process_status {
@@ -46,15 +49,45 @@ struct process {
 	 */
 	unsigned int prio_orig;	/* The original priority of the process */
 
+	struct heap_node rq_node;	/* Index into the ready queue for schedulers
+							   that pick the next process by a key */
+	struct list_head rq_list;	/* Link in the per-priority ready queue */
+	long long rq_seq;		/* Position in the ready queue to break ties.
+							   See __ready_enqueue() in pa2.c */
+	long long rq_epoch;		/* Aging epoch when it got ready */
+	unsigned int rq_cpu;	/* CPU whose ready queue it is in */
+
+	unsigned int deadline;	/* Tick by which the process should complete.
+							   0 if it has no deadline */
+	unsigned int period;	/* The process is a job of a periodic task that
+							   releases one every @period ticks. 0 if not */
+
+	struct rb_node rq_rb;	/* Link in the timeline of CFS */
+	unsigned long long vruntime;
+							/* Weighted runtime in CFS */
+	unsigned int rq_age;	/* Age when its runtime was charged the last */
+	unsigned int slice_start;
+							/* Age when it got the CPU this time */
+
+	unsigned int mlfq_level;	/* Queue level in MLFQ. 0 is the top */
+	unsigned int mlfq_used;	/* Ticks it has run for in the level */
+	unsigned int mlfq_boosts;
+							/* # of boosts in MLFQ when it got the level */
+
 
 	/** DO NOT ACCESS FOLLOWING VARIABLES **/
 	unsigned int __starts_at;	/* When to fork the process */
+	unsigned int __nr_jobs;		/* # of jobs to release every @period */
 
 	struct list_head __resources_to_acquire;
 								/* Schedule to acquire resources */
 
 	struct list_head __resources_holding;
 								/* Resources that the process is currently holding */
+
+	int __first_run_at;			/* When it ran for the first time. -1 if not yet */
+	unsigned int __blocked_at;	/* When it got blocked the last time */
+	unsigned int __blocked;		/* # of ticks it has been blocked for resources */
 };
 
 /**
@@ -64,4 +97,6 @@ void dump_status(void);
 
 #define MAX_PRIO	64	/* Maximum value for priority */
 
+#define MAX_NR_CPUS	64	/* Maximum number of CPUs to simulate */
+
 #endif
@@ -0,0 +1,260 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+
+#include "types.h"
+#include "rbtree.h"
+
+static inline bool __is_red(const struct rb_node *node)
+{
+	return node && node->color == RB_RED;
+}
+
+/* Put @new in the place of @old under the parent of @old */
+static void __replace_child(struct rb_tree *tree, struct rb_node *old, struct rb_node *new)
+{
+	struct rb_node *parent = old->parent;
+
+	if (!parent) {
+		tree->root = new;
+	} else if (parent->left == old) {
+		parent->left = new;
+	} else {
+		parent->right = new;
+	}
+	if (new) new->parent = parent;
+}
+
+static void __rotate_left(struct rb_tree *tree, struct rb_node *node)
+{
+	struct rb_node *right = node->right;
+
+	node->right = right->left;
+	if (right->left) right->left->parent = node;
+
+	__replace_child(tree, node, right);
+
+	right->left = node;
+	node->parent = right;
+}
+
+static void __rotate_right(struct rb_tree *tree, struct rb_node *node)
+{
+	struct rb_node *left = node->left;
+
+	node->left = left->right;
+	if (left->right) left->right->parent = node;
+
+	__replace_child(tree, node, left);
+
+	left->right = node;
+	node->parent = left;
+}
+
+void rb_init(struct rb_tree *tree,
+		bool (*before)(const struct rb_node *, const struct rb_node *))
+{
+	tree->root = NULL;
+	tree->leftmost = NULL;
+	tree->before = before;
+}
+
+void rb_insert(struct rb_tree *tree, struct rb_node *node)
+{
+	struct rb_node **link = &tree->root;
+	struct rb_node *parent = NULL;
+	bool leftmost = true;
+
+	while (*link) {
+		parent = *link;
+		if (tree->before(node, parent)) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = false;
+		}
+	}
+
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->color = RB_RED;
+	*link = node;
+
+	if (leftmost) tree->leftmost = node;
+
+	/* Fix up two reds in a row */
+	while (__is_red(parent = node->parent)) {
+		struct rb_node *grandparent = parent->parent;
+
+		if (parent == grandparent->left) {
+			struct rb_node *uncle = grandparent->right;
+
+			if (__is_red(uncle)) {
+				parent->color = uncle->color = RB_BLACK;
+				grandparent->color = RB_RED;
+				node = grandparent;
+				continue;
+			}
+			if (node == parent->right) {
+				__rotate_left(tree, parent);
+				parent = node;
+			}
+			parent->color = RB_BLACK;
+			grandparent->color = RB_RED;
+			__rotate_right(tree, grandparent);
+			break;
+		} else {
+			struct rb_node *uncle = grandparent->left;
+
+			if (__is_red(uncle)) {
+				parent->color = uncle->color = RB_BLACK;
+				grandparent->color = RB_RED;
+				node = grandparent;
+				continue;
+			}
+			if (node == parent->left) {
+				__rotate_right(tree, parent);
+				parent = node;
+			}
+			parent->color = RB_BLACK;
+			grandparent->color = RB_RED;
+			__rotate_left(tree, grandparent);
+			break;
+		}
+	}
+	tree->root->color = RB_BLACK;
+}
+
+/* @node under @parent lacks a black on its paths. Fix it up */
+static void __erase_fixup(struct rb_tree *tree, struct rb_node *node, struct rb_node *parent)
+{
+	while (node != tree->root && !__is_red(node)) {
+		if (node == parent->left) {
+			struct rb_node *sibling = parent->right;
+
+			if (__is_red(sibling)) {
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				__rotate_left(tree, parent);
+				sibling = parent->right;
+			}
+			if (!__is_red(sibling->left) && !__is_red(sibling->right)) {
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (!__is_red(sibling->right)) {
+				sibling->left->color = RB_BLACK;
+				sibling->color = RB_RED;
+				__rotate_right(tree, sibling);
+				sibling = parent->right;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->right->color = RB_BLACK;
+			__rotate_left(tree, parent);
+		} else {
+			struct rb_node *sibling = parent->left;
+
+			if (__is_red(sibling)) {
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				__rotate_right(tree, parent);
+				sibling = parent->left;
+			}
+			if (!__is_red(sibling->left) && !__is_red(sibling->right)) {
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (!__is_red(sibling->left)) {
+				sibling->right->color = RB_BLACK;
+				sibling->color = RB_RED;
+				__rotate_left(tree, sibling);
+				sibling = parent->left;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->left->color = RB_BLACK;
+			__rotate_right(tree, parent);
+		}
+		node = tree->root;
+		break;
+	}
+	if (node) node->color = RB_BLACK;
+}
+
+void rb_erase(struct rb_tree *tree, struct rb_node *node)
+{
+	struct rb_node *child, *parent;
+	enum rb_color erased = node->color;
+
+	if (tree->leftmost == node) tree->leftmost = rb_next(node);
+
+	if (!node->left) {
+		child = node->right;
+		parent = node->parent;
+		__replace_child(tree, node, child);
+	} else if (!node->right) {
+		child = node->left;
+		parent = node->parent;
+		__replace_child(tree, node, child);
+	} else {
+		/* Replace @node with its successor */
+		struct rb_node *successor = node->right;
+
+		while (successor->left) successor = successor->left;
+
+		erased = successor->color;
+		child = successor->right;
+
+		if (successor->parent == node) {
+			parent = successor;
+		} else {
+			parent = successor->parent;
+			__replace_child(tree, successor, child);
+			successor->right = node->right;
+			successor->right->parent = successor;
+		}
+		__replace_child(tree, node, successor);
+		successor->left = node->left;
+		successor->left->parent = successor;
+		successor->color = node->color;
+	}
+
+	if (erased == RB_BLACK) __erase_fixup(tree, child, parent);
+
+	node->parent = node->left = node->right = NULL;
+	node->color = RB_NONE;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (node->right) {
+		node = node->right;
+		while (node->left) node = node->left;
+		return (struct rb_node *)node;
+	}
+
+	while ((parent = node->parent) && node == parent->right) {
+		node = parent;
+	}
+	return parent;
+}
@@ -0,0 +1,86 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __RBTREE_H__
+#define __RBTREE_H__
+
+/**
+ * Intrusive red-black tree. Embed struct rb_node into the structure to
+ * sort, and get the structure back with container_of(). Insertion and
+ * removal take O(log n), and the first node is cached so that it is found
+ * in O(1). Nodes that compare equal are kept in the order of insertion.
+ *
+ * A node in a zero-initialized structure is not in any tree, and is ready
+ * to use.
+ */
+enum rb_color {
+	RB_NONE = 0,	/* Not in a tree */
+	RB_RED,
+	RB_BLACK,
+};
+
+struct rb_node {
+	struct rb_node *parent;
+	struct rb_node *left;
+	struct rb_node *right;
+	enum rb_color color;
+};
+
+struct rb_tree {
+	struct rb_node *root;
+	struct rb_node *leftmost;	/* The first node */
+
+	/* Return true if @a should come earlier than @b */
+	bool (*before)(const struct rb_node *a, const struct rb_node *b);
+};
+
+static inline bool rb_queued(const struct rb_node *node)
+{
+	return node->color != RB_NONE;
+}
+
+static inline bool rb_empty(const struct rb_tree *tree)
+{
+	return tree->root == NULL;
+}
+
+static inline struct rb_node *rb_first(const struct rb_tree *tree)
+{
+	return tree->leftmost;
+}
+
+void rb_init(struct rb_tree *tree,
+		bool (*before)(const struct rb_node *, const struct rb_node *));
+
+/***********************************************************************
+ * rb_insert() / rb_erase()
+ *
+ * DESCRIPTION
+ *  rb_insert() puts @node into @tree after the nodes that do not come
+ *  later than it. rb_erase() takes @node out of @tree.
+ */
+void rb_insert(struct rb_tree *tree, struct rb_node *node);
+void rb_erase(struct rb_tree *tree, struct rb_node *node);
+
+/***********************************************************************
+ * rb_next()
+ *
+ * DESCRIPTION
+ *  Return the node that comes right after @node, or NULL if @node is the
+ *  last one.
+ */
+struct rb_node *rb_next(const struct rb_node *node);
+
+#endif
@@ -20,37 +20,40 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <math.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "types.h"
 #include "list_head.h"
 
-#include "parser.h"
 #include "process.h"
 #include "resource.h"
+#include "simulation.h"
 
 #include "sched.h"
+#include "evlog.h"
 
 /**
- * List head to hold the processes ready to run
- */
-LIST_HEAD(readyqueue);
-
-/**
- * The process that is currently running
+ * The simulation this thread is working on. See simulation.h for what it
+ * keeps. It is @main_sim unless all the schedulers are simulated with -A
  */
-struct process *current = NULL;
+static struct simulation main_sim;
+__thread struct simulation *sim = &main_sim;
 
 /**
- * Number of generated ticks since the simulator was started
+ * Number of CPUs in the system. Set with -n option. The simulator looks into
+ * one CPU at a time, which is @this_cpu. @current and @readyqueue are the
+ * ones of @this_cpu, and the other CPUs keep theirs in @__cpus.
  */
-unsigned int ticks = 0;
-
-/**
- * Resources in the system.
- */
-struct resource resources[NR_RESOURCES];
+unsigned int nr_cpus = 1;
 
 /**
  * Following code is to maintain the simulator itself.
@@ -62,10 +65,41 @@ struct resource_schedule {
 	struct list_head list;
 };
 
-static LIST_HEAD(__forkqueue);
-
 bool quiet = false;
 
+/**
+ * Jump over idle stretches to the next fork. Set with -e option
+ */
+static bool event_driven = false;
+
+/**
+ * Simulate all the schedulers over the workload at once, and compare them.
+ * Set with -A option
+ */
+static bool all_schedulers = false;
+
+/**
+ * Print the metrics of the processes at the end. Set with -M option
+ */
+static bool print_metrics = false;
+
+/**
+ * Target latency and minimum granularity of CFS in ticks. Set with -L and
+ * -G options
+ */
+unsigned int cfs_latency = 8;
+unsigned int cfs_min_granularity = 1;
+
+/**
+ * Number of levels, the quantum of each level, and the boost period of
+ * MLFQ in ticks. Set with -N, -T, and -B options. The levels without their
+ * quanta given have twice the quantum of the one above
+ */
+unsigned int mlfq_levels = 3;
+unsigned int mlfq_quanta[MAX_PRIO] = { 2 };
+unsigned int mlfq_boost_period = 50;
+static int nr_mlfq_quanta = 1;
+
 static const char * __process_status_sz[] = {
 	"RDY",
 	"RUN",
@@ -84,6 +118,10 @@ extern struct scheduler prio_scheduler;
 extern struct scheduler pa_scheduler;
 extern struct scheduler pcp_scheduler;
 extern struct scheduler pip_scheduler;
+extern struct scheduler cfs_scheduler;
+extern struct scheduler edf_scheduler;
+extern struct scheduler rm_scheduler;
+extern struct scheduler mlfq_scheduler;
 
 static struct scheduler *sched = &fifo_scheduler;
 
@@ -127,17 +165,29 @@ void dump_status(void)
 	return;
 }
 
-#define __print_event(pid, string, args...) do { \
-	fprintf(stderr, "%3d: ", ticks); \
-	for (int i = 0; i < pid; i++) { \
-		fprintf(stderr, "    "); \
-	} \
-	fprintf(stderr, string "\n", ##args); \
-} while (0);
+/**
+ * Write the binary event log to this file instead of printing the events.
+ * Set with -l option
+ */
+static char *event_log = NULL;
 
-static inline bool strmatch(char * const str, const char *expect)
+static void __print_event(enum event_type type, int pid, unsigned int arg)
 {
-	return (strlen(str) == strlen(expect)) && (strncmp(str, expect, strlen(expect)) == 0);
+	struct event_record ev = {
+		.tick = ticks,
+		.pid = pid,
+		.arg = arg,
+		.type = type,
+		.cpu = this_cpu,
+	};
+
+	if (all_schedulers) return;
+
+	if (event_log) {
+		log_event(&ev);
+	} else {
+		print_event(stderr, &ev, nr_cpus > 1);
+	}
 }
 
 static void __briefing_process(struct process *p)
@@ -150,101 +200,528 @@ static void __briefing_process(struct process *p)
 				p->pid, p->__starts_at, p->lifespan,
 				p->lifespan >= 2 ? "s" : "", p->prio);
 
+	if (p->period) {
+		printf("    Release %u job%s every %u ticks, each due in %u ticks\n",
+				p->__nr_jobs, p->__nr_jobs >= 2 ? "s" : "", p->period,
+				p->deadline - p->__starts_at);
+	} else if (p->deadline) {
+		printf("    Due at tick %u\n", p->deadline);
+	}
+
 	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
 		printf("    Acquire resource %d at %d for %d\n", rs->resource_id, rs->at, rs->duration);
 	}
 }
 
-static int __load_script(char * const filename)
+/**
+ * Merge @from into @into, both sorted by __starts_at. The ones in @into
+ * come first on ties.
+ */
+static void __merge_forks(struct list_head *into, struct list_head *from)
 {
-	char line[256];
-	struct process *p = NULL;
+	struct list_head *pos = into->next;
+
+	while (!list_empty(from)) {
+		struct process *p = list_first_entry(from, struct process, list);
+
+		while (pos != into &&
+				list_entry(pos, struct process, list)->__starts_at <= p->__starts_at) {
+			pos = pos->next;
+		}
+		list_move_tail(&p->list, pos);
+	}
+}
+
+/**
+ * Sort the @nr processes in @head by __starts_at, keeping the script order
+ * of the ones starting at the same tick.
+ */
+static void __sort_forks(struct list_head *head, int nr)
+{
+	LIST_HEAD(half);
+
+	if (nr < 2) return;
+
+	for (int i = 0; i < nr / 2; i++) {
+		list_move_tail(head->next, &half);
+	}
+	__sort_forks(&half, nr / 2);
+	__sort_forks(head, nr - nr / 2);
+	__merge_forks(&half, head);
+	list_splice_init(&half, head);
+}
+
+/**
+ * Duplicate @p with its resource schedules. Used to release the jobs of a
+ * periodic process, and to give a copy of the workload to each simulation
+ * of -A
+ */
+static struct process *__clone_process(struct process *p)
+{
+	struct process *clone = malloc(sizeof(*clone));
+	struct resource_schedule *rs;
+
+	*clone = *p;
+
+	INIT_LIST_HEAD(&clone->list);
+	INIT_LIST_HEAD(&clone->rq_list);
+	INIT_LIST_HEAD(&clone->__resources_to_acquire);
+	INIT_LIST_HEAD(&clone->__resources_holding);
+
+	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+		struct resource_schedule *crs = malloc(sizeof(*crs));
+
+		*crs = *rs;
+		list_add_tail(&crs->list, &clone->__resources_to_acquire);
+	}
+	return clone;
+}
+
+static void __free_process(struct process *p)
+{
+	struct resource_schedule *rs, *tmp;
+
+	list_for_each_entry_safe(rs, tmp, &p->__resources_to_acquire, list) {
+		list_del(&rs->list);
+		free(rs);
+	}
+	free(p);
+}
 
-	FILE *file = fopen(filename, "r");
-	while (fgets(line, sizeof(line), file)) {
-		char *tokens[32] = { NULL };
-		int nr_tokens;
 
-		parse_command(line, &nr_tokens, tokens);
+/***********************************************************************
+ * Periodic tasks
+ *
+ * A process with `period` in the script is a periodic task. It releases
+ * `jobs` jobs every @period ticks from its fork tick, and each job is a
+ * process of its own that runs for the lifespan. A job should complete by
+ * `deadline` ticks after its release, or by the next release if the
+ * deadline is not given. All the jobs are put into the fork queue when the
+ * task is loaded, and @rt_tasks keeps the timing of the tasks for the
+ * schedulability tests at the end.
+ */
+struct rt_task {
+	unsigned int pid;
+	unsigned int wcet;		/* Lifespan of each job */
+	unsigned int period;
+	unsigned int deadline;	/* Relative to the release */
+};
+
+static struct rt_task *rt_tasks = NULL;
+static unsigned int nr_rt_tasks = 0;
+static unsigned int rt_tasks_size = 0;
+
+/**
+ * Number of the processes with a deadline in the workload. The deadlines
+ * are reported at the end if there is any
+ */
+static unsigned int nr_deadline_jobs = 0;
+
+/* Put @p into the fork queue after the ones forking by its fork tick */
+static void __queue_fork(struct process *p)
+{
+	struct list_head *pos = sim->__forkqueue.prev;
+
+	while (pos != &sim->__forkqueue &&
+			list_entry(pos, struct process, list)->__starts_at > p->__starts_at) {
+		pos = pos->prev;
+	}
+	list_add(&p->list, pos);
+}
+
+/**
+ * Queue the jobs of @p following @p itself, which is the first one. Return
+ * the number of the jobs queued
+ */
+static int __queue_jobs(struct process *p)
+{
+	struct rt_task *task;
+
+	if (p->deadline) nr_deadline_jobs += p->__nr_jobs;
+	if (!p->period) return 0;
+
+	if (nr_rt_tasks == rt_tasks_size) {
+		rt_tasks_size = rt_tasks_size ? rt_tasks_size * 2 : 16;
+		rt_tasks = realloc(rt_tasks, sizeof(*rt_tasks) * rt_tasks_size);
+	}
+	task = rt_tasks + nr_rt_tasks++;
+	task->pid = p->pid;
+	task->wcet = p->lifespan;
+	task->period = p->period;
+	task->deadline = p->deadline - p->__starts_at;
+
+	for (unsigned int i = 1; i < p->__nr_jobs; i++) {
+		struct process *job = __clone_process(p);
+
+		job->__starts_at += i * p->period;
+		job->deadline += i * p->period;
+		__queue_fork(job);
+	}
+	return p->__nr_jobs - 1;
+}
+
+
+/***********************************************************************
+ * Process script loader
+ *
+ * The script is mapped into memory and tokenized in place. By default,
+ * all the processes are loaded up front. In the streaming mode (-m), a
+ * process is loaded only when the simulation is about to fork it, so the
+ * processes in memory are the ones alive at the moment. The script should
+ * list the processes in the order of their fork ticks then.
+ */
+#define MAX_SCRIPT_TOKENS	32
+#define SCRIPT_DROP_CHUNK	(8UL << 20)	/* Unit to drop the parsed script */
+
+struct script_token {
+	const char *str;
+	int len;
+};
+
+static struct {
+	const char *map;
+	size_t size;
+	size_t pos;			/* Where to parse next */
+	size_t dropped;		/* The script up to here is dropped from memory */
+	unsigned int last_start;
+} script = { NULL };
+
+/**
+ * Stream the script in instead of loading it up front. Set with -m option
+ */
+static bool stream_script = false;
+
+static inline bool __token_match(const struct script_token *token, const char *expect)
+{
+	return token->len == strlen(expect) && strncmp(token->str, expect, token->len) == 0;
+}
+
+/* Same as atoi() but on a token that is not NULL-terminated */
+static int __token_int(const struct script_token *token)
+{
+	const char *str = token->str;
+	const char *end = token->str + token->len;
+	bool negative = false;
+	int value = 0;
+
+	if (str < end && (*str == '-' || *str == '+')) negative = (*str++ == '-');
+	while (str < end && isdigit((unsigned char)*str)) {
+		value = value * 10 + (*str++ - '0');
+	}
+	return negative ? -value : value;
+}
+
+/**
+ * Split the next line of the script into @tokens. Return the number of
+ * tokens, or -1 at the end of the script.
+ */
+static int __next_tokens(struct script_token tokens[])
+{
+	int nr_tokens = 0;
+
+	if (script.pos >= script.size) return -1;
+
+	while (script.pos < script.size) {
+		size_t start = script.pos;
+
+		if (script.map[script.pos] == '\n') {
+			script.pos++;
+			break;
+		}
+		if (isspace((unsigned char)script.map[script.pos])) {
+			script.pos++;
+			continue;
+		}
+
+		while (script.pos < script.size && !isspace((unsigned char)script.map[script.pos])) {
+			script.pos++;
+		}
+		if (nr_tokens < MAX_SCRIPT_TOKENS) {
+			tokens[nr_tokens].str = script.map + start;
+			tokens[nr_tokens].len = script.pos - start;
+			nr_tokens++;
+		}
+	}
+
+	/* Remove comments */
+	for (int i = 0; i < nr_tokens; i++) {
+		if (tokens[i].str[0] == '#') {
+			nr_tokens = i;
+			break;
+		}
+	}
+
+	return nr_tokens;
+}
+
+/**
+ * Load the next process description into @loaded. Return 1 if loaded, 0
+ * at the end of the script, and -1 on error.
+ */
+static int __load_process(struct process **loaded)
+{
+	struct script_token tokens[MAX_SCRIPT_TOKENS];
+	struct process *p = NULL;
+	int nr_tokens;
 
+	while ((nr_tokens = __next_tokens(tokens)) >= 0) {
 		if (nr_tokens == 0) continue;
 
-		if (strmatch(tokens[0], "process")) {
+		if (__token_match(tokens, "process")) {
 			assert(nr_tokens == 2);
 			/* Start processor description */
 			p = malloc(sizeof(*p));
 			memset(p, 0x00, sizeof(*p));
 
-			p->pid = atoi(tokens[1]);
+			p->pid = __token_int(tokens + 1);
 
 			INIT_LIST_HEAD(&p->list);
+			INIT_LIST_HEAD(&p->rq_list);
 			INIT_LIST_HEAD(&p->__resources_to_acquire);
 			INIT_LIST_HEAD(&p->__resources_holding);
 
+			p->__first_run_at = -1;
+			p->__nr_jobs = 1;
+
 			continue;
-		} else if (strmatch(tokens[0], "end")) {
+		} else if (__token_match(tokens, "end")) {
 			/* End of process description */
-			struct resource_schedule *rs;
 			assert(p);
 
-			list_add_tail(&p->list, &__forkqueue);
+			/* A job is due by the next release unless told otherwise */
+			if (p->period && !p->deadline) p->deadline = p->period;
+			if (p->deadline) p->deadline += p->__starts_at;
 
-			__briefing_process(p);
-			p = NULL;
-
-			continue;
+			*loaded = p;
+			return 1;
 		}
 
-		if (strmatch(tokens[0], "lifespan")) {
+		assert(p);
+
+		if (__token_match(tokens, "lifespan")) {
+			assert(nr_tokens == 2);
+			p->lifespan = __token_int(tokens + 1);
+		} else if (__token_match(tokens, "prio")) {
 			assert(nr_tokens == 2);
-			p->lifespan = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "prio")) {
+			p->prio = p->prio_orig = __token_int(tokens + 1);
+		} else if (__token_match(tokens, "start")) {
 			assert(nr_tokens == 2);
-			p->prio = p->prio_orig = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "start")) {
+			p->__starts_at = __token_int(tokens + 1);
+		} else if (__token_match(tokens, "deadline")) {
 			assert(nr_tokens == 2);
-			p->__starts_at = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "acquire")) {
+			p->deadline = __token_int(tokens + 1);
+			assert(p->deadline > 0);
+		} else if (__token_match(tokens, "period")) {
+			assert(nr_tokens == 2);
+			p->period = __token_int(tokens + 1);
+			assert(p->period > 0);
+		} else if (__token_match(tokens, "jobs")) {
+			assert(nr_tokens == 2);
+			p->__nr_jobs = __token_int(tokens + 1);
+			assert(p->__nr_jobs > 0);
+		} else if (__token_match(tokens, "acquire")) {
 			struct resource_schedule *rs;
 			assert(nr_tokens == 4);
 
 			rs = malloc(sizeof(*rs));
 
-			rs->resource_id = atoi(tokens[1]);
-			rs->at = atoi(tokens[2]);
-			rs->duration = atoi(tokens[3]);
+			rs->resource_id = __token_int(tokens + 1);
+			rs->at = __token_int(tokens + 2);
+			rs->duration = __token_int(tokens + 3);
 
 			list_add_tail(&rs->list, &p->__resources_to_acquire);
 		} else {
-			fprintf(stderr, "Unknown property %s\n", tokens[0]);
+			fprintf(stderr, "Unknown property %.*s\n", tokens[0].len, tokens[0].str);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void __unmap_script(void)
+{
+	if (script.map) munmap((void *)script.map, script.size);
+	script.map = NULL;
+	script.size = script.pos = 0;
+}
+
+/**
+ * Load processes in the streaming mode until the one forking after the
+ * current tick is in the fork queue, or the script is over.
+ */
+static bool __stream_script(void)
+{
+	struct process *p;
+	int ret;
+
+	while (script.map && (list_empty(&sim->__forkqueue) || script.last_start <= ticks)) {
+		ret = __load_process(&p);
+		if (ret <= 0) {
+			__unmap_script();
+			if (ret < 0) return false;
+
+			/* All briefed. Separate them as the script loaded up front does */
+			if (!quiet) printf("\n");
+			return true;
+		}
+
+		if (p->__starts_at < script.last_start) {
+			fprintf(stderr, "Process %d forks earlier than the previous one. "
+					"Cannot stream the script\n", p->pid);
+			return false;
+		}
+		script.last_start = p->__starts_at;
+
+		__queue_fork(p);
+		__queue_jobs(p);
+		__briefing_process(p);
+
+		/* Do not keep the parsed part in memory */
+		while (script.pos - script.dropped >= SCRIPT_DROP_CHUNK) {
+			madvise((void *)(script.map + script.dropped), SCRIPT_DROP_CHUNK, MADV_DONTNEED);
+			script.dropped += SCRIPT_DROP_CHUNK;
+		}
+	}
+	return true;
+}
+
+static int __load_script(char * const filename)
+{
+	struct process *p = NULL;
+	struct stat st;
+	int nr_processes = 0;
+	int fd, ret;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Unable to open %s\n", filename);
+		if (fd >= 0) close(fd);
+		return false;
+	}
+
+	if (st.st_size) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "Unable to map %s\n", filename);
+			close(fd);
 			return false;
 		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+		script.map = map;
+		script.size = st.st_size;
+	}
+	close(fd);
+
+	if (stream_script) {
+		/* Nothing to stream in, but still print the separator */
+		if (!script.map && !quiet) printf("\n");
+		return __stream_script();
+	}
+
+	while ((ret = __load_process(&p)) > 0) {
+		list_add_tail(&p->list, &sim->__forkqueue);
+		nr_processes++;
+		nr_processes += __queue_jobs(p);
+
+		__briefing_process(p);
 	}
-	fclose(file);
+	__unmap_script();
+	if (ret < 0) return false;
+
 	if (!quiet) printf("\n");
+
+	__sort_forks(&sim->__forkqueue, nr_processes);
 	return true;
 }
 
+/**
+ * Make @cpu the one to look into. Switch @current and @readyqueue to the
+ * ones of @cpu. Both are moved in O(1)
+ */
+static void __switch_cpu(unsigned int cpu)
+{
+	struct cpu *prev = sim->__cpus + this_cpu;
+	struct cpu *next = sim->__cpus + cpu;
+
+	if (cpu == this_cpu) return;
+
+	prev->curr = current;
+	list_splice_init(&readyqueue, &prev->rq);
+
+	current = next->curr;
+	list_splice_init(&next->rq, &readyqueue);
+
+	this_cpu = cpu;
+}
 
 /**
- * Fork process on schedule
+ * Fork process on schedule. New processes are spread over the CPUs in
+ * round-robin
  */
 static int __fork_on_schedule()
 {
 	int nr_forked = 0;
-	struct process *p, *tmp;
-	list_for_each_entry_safe(p, tmp, &__forkqueue, list) {
-		if (p->__starts_at <= ticks) {
-			list_move_tail(&p->list, &readyqueue);
-			p->status = PROCESS_READY;
-			__print_event(p->pid, "N");
-			if (sched->forked) sched->forked(p);
-			nr_forked++;
-		}
+	struct process *p;
+
+	if (!__stream_script()) {
+		close_event_log();
+		exit(EXIT_FAILURE);
+	}
+
+	while (!list_empty(&sim->__forkqueue)) {
+		p = list_first_entry(&sim->__forkqueue, struct process, list);
+		if (p->__starts_at > ticks) break;
+
+		__switch_cpu(sim->__fork_cpu);
+		sim->__fork_cpu = (sim->__fork_cpu + 1) % nr_cpus;
+
+		list_move_tail(&p->list, &readyqueue);
+		p->status = PROCESS_READY;
+		__print_event(EVENT_FORK, p->pid, 0);
+		if (sim->sched->forked) sim->sched->forked(p);
+		nr_forked++;
 	}
 	return nr_forked;
 }
 
+/**
+ * Record the metrics of @p which exits at this tick. The processes have not
+ * run while they were neither running nor blocked
+ */
+static void __record_metrics(struct process *p)
+{
+	struct process_metrics *m;
+
+	if (sim->__nr_exited == sim->__metrics_size) {
+		sim->__metrics_size = sim->__metrics_size ? sim->__metrics_size * 2 : 1024;
+		sim->__metrics = realloc(sim->__metrics,
+				sizeof(*sim->__metrics) * sim->__metrics_size);
+	}
+	m = sim->__metrics + sim->__nr_exited++;
+
+	m->values[METRIC_TURNAROUND] = ticks - p->__starts_at;
+	m->values[METRIC_RESPONSE] = p->__first_run_at - p->__starts_at;
+	m->values[METRIC_BLOCKED] = p->__blocked;
+	m->values[METRIC_WAITING] = ticks - p->__starts_at - p->lifespan - p->__blocked;
+
+	sim->__busy_ticks += p->lifespan;
+}
+
+/* Record how late @p completes at this tick against its deadline */
+static void __record_lateness(struct process *p)
+{
+	if (sim->__nr_deadlines == sim->__lateness_size) {
+		sim->__lateness_size = sim->__lateness_size ? sim->__lateness_size * 2 : 1024;
+		sim->__lateness = realloc(sim->__lateness,
+				sizeof(*sim->__lateness) * sim->__lateness_size);
+	}
+	sim->__lateness[sim->__nr_deadlines++] = (int)(ticks - p->deadline);
+
+	if (ticks > p->deadline) sim->__nr_missed++;
+}
+
 /**
  * Exit the process
  */
@@ -259,9 +736,12 @@ static void __exit_process(struct process *p)
 	/* Make sure there is no pending resource to acquire */
 	assert(list_empty(&p->__resources_to_acquire));
 
-	if (sched->exiting) sched->exiting(p);
+	if (sim->sched->exiting) sim->sched->exiting(p);
 
-	__print_event(p->pid, "X");
+	__print_event(EVENT_EXIT, p->pid, 0);
+
+	if (print_metrics || all_schedulers) __record_metrics(p);
+	if (p->deadline) __record_lateness(p);
 
 	free(p);
 }
@@ -276,13 +756,13 @@ static bool __run_current_acquire()
 
 	list_for_each_entry_safe(rs, tmp, &current->__resources_to_acquire, list) {
 		if (rs->at == current->age) {
-			assert(sched->acquire && "scheduler.acquire() not implemented");
+			assert(sim->sched->acquire && "scheduler.acquire() not implemented");
 
 			/* Callback to acquire the resource */
-			if (sched->acquire(rs->resource_id)) {
+			if (sim->sched->acquire(rs->resource_id)) {
 				list_move_tail(&rs->list, &current->__resources_holding);
 
-				__print_event(current->pid, "+%d", rs->resource_id);
+				__print_event(EVENT_ACQUIRE, current->pid, rs->resource_id);
 			} else {
 				return false;
 			}
@@ -293,113 +773,704 @@ static bool __run_current_acquire()
 }
 
 /**
- * Process resource release
+ * Release the resource @resource_id with the scheduler. The waiters that it
+ * wakes up have been blocked since they failed to acquire the resource up
+ * to this tick
+ */
+static void __release_resource(int resource_id)
+{
+	struct resource *r = resources + resource_id;
+	struct process *p;
+
+	list_for_each_entry(p, &r->waitqueue, list) {
+		p->__blocked += ticks - p->__blocked_at + 1;
+	}
+
+	sim->sched->release(resource_id);
+
+	/* Take it back from the ones still waiting */
+	list_for_each_entry(p, &r->waitqueue, list) {
+		p->__blocked -= ticks - p->__blocked_at + 1;
+	}
+}
+
+/**
+ * Process resource release. Return true if any is released
  */
-static void __run_current_release()
+static bool __run_current_release()
 {
 	struct resource_schedule *rs, *tmp;
+	bool released = false;
 
 	list_for_each_entry_safe(rs, tmp, &current->__resources_holding, list) {
 		if (--rs->duration == 0) {
-			assert(sched->release && "scheduler.release() not implemented");
+			assert(sim->sched->release && "scheduler.release() not implemented");
 
 			/* Callback the release() */
-			sched->release(rs->resource_id);
+			__release_resource(rs->resource_id);
 
-			__print_event(current->pid, "-%d", rs->resource_id);
+			__print_event(EVENT_RELEASE, current->pid, rs->resource_id);
 
 			list_del(&rs->list);
 			free(rs);
+			released = true;
 		}
 	}
+	return released;
 }
 
 
-/***********************************************************************
- * The main loop for the scheduler simulation
+/**
+ * Run @current over the following ticks in one step while nothing but its
+ * aging happens; up to the next decision of the scheduler, the next fork,
+ * and the next resource acquisition or release of @current.
  */
-static void __do_simulation(void)
+static void __run_current_burst()
 {
-	assert(sched->schedule && "scheduler.schedule() not implemented");
-
-	while (true) {
-		struct process *prev;
+	struct resource_schedule *rs;
+	unsigned int nr_ticks;
 
-		/* Fork processes on schedule */
-		__fork_on_schedule();
+	/* Other CPUs should go on tick by tick */
+	if (!sim->sched->next_decision || nr_cpus > 1) return;
 
-		/* Ask scheduler to pick the next process to run */
-		prev = current;
-		current = sched->schedule();
+	nr_ticks = sim->sched->next_decision();
 
-		/* If the system ran a process in the previous tick, */
-		if (prev) {
-			/* Update the process status */
-			if (prev->status == PROCESS_RUNNING) {
-				prev->status = PROCESS_READY;
-			}
+	if (!list_empty(&sim->__forkqueue)) {
+		unsigned int next_fork =
+			list_first_entry(&sim->__forkqueue, struct process, list)->__starts_at;
 
-			/* Decommission it if completed */
-			if (prev->age == prev->lifespan) {
-				prev->status = PROCESS_EXIT;
-				__exit_process(prev);
-			}
-		}
+		if (next_fork - ticks - 1 < nr_ticks) nr_ticks = next_fork - ticks - 1;
+	}
+	list_for_each_entry(rs, &current->__resources_to_acquire, list) {
+		if (rs->at < current->age) continue;
+		if (rs->at - current->age < nr_ticks) nr_ticks = rs->at - current->age;
+	}
+	list_for_each_entry(rs, &current->__resources_holding, list) {
+		if (rs->duration - 1 < nr_ticks) nr_ticks = rs->duration - 1;
+	}
 
-		/* No process is ready to run at this moment */
-		if (!current) {
-			/* Quit simulation if no pending process exists */
-			if (list_empty(&readyqueue) && list_empty(&__forkqueue)) {
-				break;
-			}
+	if (!nr_ticks) return;
 
-			/* Idle temporarily */
-			fprintf(stderr, "%3d: idle\n", ticks);
-		} else {
+	ticks++;
+	__print_event(EVENT_RUN, current->pid, nr_ticks);
+	ticks += nr_ticks - 1;
 
-			/* Execute the current process */
-			current->status = PROCESS_RUNNING;
+	current->age += nr_ticks;
+	list_for_each_entry(rs, &current->__resources_holding, list) {
+		rs->duration -= nr_ticks;
+	}
+}
 
-			/* Ensure that @current is detached from any list */
-			assert(list_empty(&current->list));
 
-			/* Try acquiring scheduled resources */
-			if (__run_current_acquire()) {
-				/* Succesfully acquired all the resources to make a progress! */
-				__print_event(current->pid, "%d", current->pid);
+/***********************************************************************
+ * The main loop for the scheduler simulation
+ */
+static void __schedule_cpu(void)
+{
+	struct process *prev;
 
-				/* So, it ages by one tick */
-				current->age++;
+	/* Ask scheduler to pick the next process to run */
+	prev = current;
+	current = sim->sched->schedule();
 
-				/* And performs scheduled releases */
-				__run_current_release();
-			} else {
-				/**
-				 * The current is blocked while acquiring resource(s).
-				 * In this case, @current could not make a progress in this tick
-				 */
-				__print_event(current->pid, "=");
+	if (current && current != prev) sim->__nr_switches++;
 
-				/* Thus, it is not get aged nor unable to perform releases */
-			}
+	/* If the system ran a process in the previous tick, */
+	if (prev) {
+		/* Update the process status */
+		if (prev->status == PROCESS_RUNNING) {
+			prev->status = PROCESS_READY;
 		}
 
-		/* Increase the tick counter */
-		ticks++;
+		/* Decommission it if completed */
+		if (prev->age == prev->lifespan) {
+			prev->status = PROCESS_EXIT;
+			__exit_process(prev);
+		}
 	}
 }
 
-
-static void __initialize(void)
+static void __run_cpu(void)
 {
-	INIT_LIST_HEAD(&readyqueue);
+	/* No process is ready to run at this moment */
+	if (!current) {
+		/* Idle temporarily */
+		__print_event(EVENT_IDLE, 0, 1);
+	} else {
+
+		/* Execute the current process */
+		current->status = PROCESS_RUNNING;
+
+		/* Ensure that @current is detached from any list */
+		assert(list_empty(&current->list));
+
+		/* Try acquiring scheduled resources */
+		if (__run_current_acquire()) {
+			/* Succesfully acquired all the resources to make a progress! */
+			if (current->__first_run_at < 0) current->__first_run_at = ticks;
+
+			__print_event(EVENT_RUN, current->pid, 1);
+
+			/* So, it ages by one tick */
+			current->age++;
+
+			/**
+			 * And performs scheduled releases. Run on while the scheduler
+			 * does not need to decide, unless the releases may have woken
+			 * up someone to preempt it
+			 */
+			if (!__run_current_release()) __run_current_burst();
+		} else {
+			/**
+			 * The current is blocked while acquiring resource(s).
+			 * In this case, @current could not make a progress in this tick
+			 */
+			__print_event(EVENT_BLOCK, current->pid, 0);
+
+			/* Thus, it is not get aged nor unable to perform releases */
+			current->__blocked_at = ticks;
+
+			/**
+			 * Another CPU may wake it up before this CPU schedules again.
+			 * Do not leave it as @current here then
+			 */
+			if (nr_cpus > 1) current = NULL;
+		}
+	}
+}
 
-	for (int i = 0; i < NR_RESOURCES; i++) {
+
+/***********************************************************************
+ * Load balancing among CPUs
+ *
+ * With -b, an idle CPU with nothing ready steals the process at the tail
+ * of the ready queue of another CPU. The victim is chosen by the policy;
+ *
+ *   random   A random CPU. Nothing is stolen if it has nothing ready
+ *   busiest  The CPU with the most ready processes
+ *   near     The busiest in the node of the thief, and then the busiest
+ *            in the others. A node is CPUS_PER_NODE adjacent CPUs
+ *
+ * Or, with -b push, the busiest CPU pushes its ready processes to the
+ * idlest one every PUSH_PERIOD ticks until their loads are even.
+ *
+ * The load of a CPU is the number of its ready processes plus the running
+ * one, and the imbalance is the gap between the largest and the smallest
+ * loads. It is tracked over time in NR_IMBALANCE_WINDOWS windows, which
+ * are merged in pairs to cover twice as long when the ticks run out of
+ * them. Without -b, the CPUs are left alone and nothing is tracked.
+ */
+enum balance_policy {
+	BALANCE_NONE = 0,
+	BALANCE_STEAL_RANDOM,
+	BALANCE_STEAL_BUSIEST,
+	BALANCE_STEAL_NEAR,
+	BALANCE_PUSH,
+	NR_BALANCE_POLICIES,
+};
+
+static const char * const __balance_policy_sz[] = {
+	"none",
+	"random",
+	"busiest",
+	"near",
+	"push",
+};
+
+#define CPUS_PER_NODE			4
+#define PUSH_PERIOD				4
+#define BALANCE_SEED			0x5eed
+
+static enum balance_policy balance_policy = BALANCE_NONE;
+
+static inline struct process *__current_of(unsigned int cpu)
+{
+	return cpu == this_cpu ? current : sim->__cpus[cpu].curr;
+}
+
+static inline unsigned int __nr_ready(unsigned int cpu)
+{
+	return sim->sched->nr_ready(cpu);
+}
+
+static inline unsigned int __load_of(unsigned int cpu)
+{
+	return __nr_ready(cpu) + (__current_of(cpu) ? 1 : 0);
+}
+
+/**
+ * Move the process at the tail of the ready queue of @from to the tail of
+ * the ready queue of @to
+ */
+static void __migrate(unsigned int from, unsigned int to)
+{
+	struct process *p;
+
+	__switch_cpu(from);
+	p = list_last_entry(&readyqueue, struct process, list);
+	if (sim->sched->migrating) sim->sched->migrating(p);
+	list_del_init(&p->list);
+
+	__switch_cpu(to);
+	list_add_tail(&p->list, &readyqueue);
+	if (sim->sched->migrated) sim->sched->migrated(p);
+
+	__print_event(EVENT_MIGRATE, p->pid, from);
+	sim->__nr_migrations++;
+}
+
+/* The CPU with the most ready processes except @cpu. Only in its node if @near */
+static int __busiest_cpu(unsigned int cpu, bool near)
+{
+	int busiest = -1;
+
+	for (unsigned int i = 0; i < nr_cpus; i++) {
+		if (i == cpu || !__nr_ready(i)) continue;
+		if (near && i / CPUS_PER_NODE != cpu / CPUS_PER_NODE) continue;
+
+		if (busiest < 0 || __nr_ready(i) > __nr_ready(busiest)) busiest = i;
+	}
+	return busiest;
+}
+
+static int __pick_victim(unsigned int cpu)
+{
+	int victim;
+
+	switch (balance_policy) {
+	case BALANCE_STEAL_RANDOM:
+		victim = rand_r(&sim->__balance_seed) % (nr_cpus - 1);
+		if (victim >= cpu) victim++;
+		return __nr_ready(victim) ? victim : -1;
+	case BALANCE_STEAL_NEAR:
+		victim = __busiest_cpu(cpu, true);
+		if (victim >= 0) return victim;
+		return __busiest_cpu(cpu, false);
+	case BALANCE_STEAL_BUSIEST:
+		return __busiest_cpu(cpu, false);
+	default:
+		return -1;
+	}
+}
+
+static void __push_ready(void)
+{
+	while (true) {
+		int busiest = -1, idlest = -1;
+
+		for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+			if (__nr_ready(cpu) && (busiest < 0 || __load_of(cpu) > __load_of(busiest))) {
+				busiest = cpu;
+			}
+			if (idlest < 0 || __load_of(cpu) < __load_of(idlest)) {
+				idlest = cpu;
+			}
+		}
+		if (busiest < 0 || __load_of(busiest) < __load_of(idlest) + 2) break;
+
+		__migrate(busiest, idlest);
+	}
+}
+
+static void __account_imbalance(void)
+{
+	unsigned int max = 0, min = UINT_MAX;
+	unsigned int window;
+
+	for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+		unsigned int load = __load_of(cpu);
+
+		if (load > max) max = load;
+		if (load < min) min = load;
+	}
+	if (max - min > sim->__max_imbalance) sim->__max_imbalance = max - min;
+
+	while ((window = ticks / sim->__imbalance_window) >= NR_IMBALANCE_WINDOWS) {
+		for (int i = 0; i < NR_IMBALANCE_WINDOWS / 2; i++) {
+			sim->__imbalances[i].imbalance = sim->__imbalances[i * 2].imbalance + sim->__imbalances[i * 2 + 1].imbalance;
+			sim->__imbalances[i].nr_ticks = sim->__imbalances[i * 2].nr_ticks + sim->__imbalances[i * 2 + 1].nr_ticks;
+		}
+		memset(sim->__imbalances + NR_IMBALANCE_WINDOWS / 2, 0,
+				sizeof(*sim->__imbalances) * NR_IMBALANCE_WINDOWS / 2);
+		sim->__imbalance_window *= 2;
+	}
+	sim->__imbalances[window].imbalance += max - min;
+	sim->__imbalances[window].nr_ticks++;
+}
+
+/**
+ * Balance the load after all the CPUs made their decisions for this tick,
+ * and let the CPUs which got processes to run pick one
+ */
+static void __balance_cpus(void)
+{
+	if (balance_policy == BALANCE_NONE || !sim->sched->nr_ready) return;
+
+	if (balance_policy == BALANCE_PUSH) {
+		if (ticks % PUSH_PERIOD == 0) __push_ready();
+	} else {
+		for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+			int victim;
+
+			if (__current_of(cpu) || __nr_ready(cpu)) continue;
+
+			victim = __pick_victim(cpu);
+			if (victim >= 0) __migrate(victim, cpu);
+		}
+	}
+
+	for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+		if (__current_of(cpu) || !__nr_ready(cpu)) continue;
+
+		__switch_cpu(cpu);
+		__schedule_cpu();
+	}
+
+	__account_imbalance();
+}
+
+/* Average imbalance over the ticks simulated. <0 if no tick was */
+static double __average_imbalance(void)
+{
+	unsigned long long imbalance = 0;
+	unsigned int nr_ticks = 0;
+
+	for (int i = 0; i < NR_IMBALANCE_WINDOWS; i++) {
+		imbalance += sim->__imbalances[i].imbalance;
+		nr_ticks += sim->__imbalances[i].nr_ticks;
+	}
+	return nr_ticks ? (double)imbalance / nr_ticks : -1;
+}
+
+static void __report_balance(void)
+{
+	double imbalance = __average_imbalance();
+
+	if (imbalance < 0) return;
+
+	printf("\n");
+	printf("Load balancing: %s\n", __balance_policy_sz[balance_policy]);
+	printf("  Migrations: %llu\n", sim->__nr_migrations);
+	printf("  Imbalance: %.2f on average, %u at most\n",
+			imbalance, sim->__max_imbalance);
+	printf("\n");
+	printf("  %-17s  %9s\n", "ticks", "imbalance");
+	for (int i = 0; i < NR_IMBALANCE_WINDOWS; i++) {
+		if (!sim->__imbalances[i].nr_ticks) continue;
+
+		printf("  %8u-%-8u  %9.2f\n",
+				i * sim->__imbalance_window, (i + 1) * sim->__imbalance_window - 1,
+				(double)sim->__imbalances[i].imbalance / sim->__imbalances[i].nr_ticks);
+	}
+}
+
+
+/***********************************************************************
+ * Metrics of the processes
+ *
+ * The metrics of each process are recorded when it exits, and summarized
+ * into the average and the percentiles at the end.
+ */
+struct metric_summary {
+	double avg;
+	unsigned int p50;
+	unsigned int p95;
+	unsigned int p99;
+};
+
+static const char * const __metric_sz[] = {
+	"turnaround",
+	"response",
+	"waiting",
+	"blocked",
+};
+
+static int __compare_ticks(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Summarize each metric into @summaries. Return false if no process exited */
+static bool __summarize_metrics(struct metric_summary summaries[NR_METRICS])
+{
+	unsigned int nr = sim->__nr_exited;
+	unsigned int *values;
+
+	if (!nr) return false;
+
+	values = malloc(sizeof(*values) * nr);
+
+	for (int metric = 0; metric < NR_METRICS; metric++) {
+		struct metric_summary *summary = summaries + metric;
+		unsigned long long sum = 0;
+
+		for (unsigned int i = 0; i < nr; i++) {
+			values[i] = sim->__metrics[i].values[metric];
+			sum += values[i];
+		}
+		qsort(values, nr, sizeof(*values), __compare_ticks);
+
+		summary->avg = (double)sum / nr;
+		summary->p50 = values[nr * 50 / 100];
+		summary->p95 = values[nr * 95 / 100];
+		summary->p99 = values[nr * 99 / 100];
+	}
+
+	free(values);
+	return true;
+}
+
+static inline double __utilization(void)
+{
+	return ticks ? (double)sim->__busy_ticks * 100 / ((double)ticks * nr_cpus) : 0;
+}
+
+static void __report_metrics(void)
+{
+	struct metric_summary summaries[NR_METRICS];
+
+	if (!__summarize_metrics(summaries)) return;
+
+	printf("\n");
+	printf("Metrics\n");
+	printf("  Throughput: %u processes in %u ticks (%.3f per tick)\n",
+			sim->__nr_exited, ticks, ticks ? (double)sim->__nr_exited / ticks : 0);
+	printf("  CPU utilization: %.2f%%\n", __utilization());
+	printf("  Context switches: %llu\n", sim->__nr_switches);
+	printf("\n");
+	printf("  %-10s  %10s %8s %8s %8s\n", "ticks", "avg", "p50", "p95", "p99");
+	for (int metric = 0; metric < NR_METRICS; metric++) {
+		struct metric_summary *summary = summaries + metric;
+
+		printf("  %-10s  %10.2f %8u %8u %8u\n", __metric_sz[metric],
+				summary->avg, summary->p50, summary->p95, summary->p99);
+	}
+}
+
+
+/***********************************************************************
+ * Deadlines of the processes
+ *
+ * The lateness of a process with a deadline is recorded when it exits;
+ * how many ticks after the deadline it completes, which is negative if it
+ * completes early. The periodic tasks are also tested whether EDF and RM
+ * can meet all their deadlines. The tests assume that the tasks run on a
+ * CPU without blocking for resources, and release their first jobs at the
+ * same tick.
+ */
+struct lateness_summary {
+	double avg;
+	int p50;
+	int p99;
+	int max;
+};
+
+static int __compare_lateness(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Summarize the lateness into @summary. Return false if no one was due */
+static bool __summarize_lateness(struct lateness_summary *summary)
+{
+	unsigned int nr = sim->__nr_deadlines;
+	long long sum = 0;
+
+	if (!nr) return false;
+
+	qsort(sim->__lateness, nr, sizeof(*sim->__lateness), __compare_lateness);
+	for (unsigned int i = 0; i < nr; i++) {
+		sum += sim->__lateness[i];
+	}
+
+	summary->avg = (double)sum / nr;
+	summary->p50 = sim->__lateness[nr * 50 / 100];
+	summary->p99 = sim->__lateness[nr * 99 / 100];
+	summary->max = sim->__lateness[nr - 1];
+	return true;
+}
+
+/**
+ * Worst-case response time of @task under RM, where the tasks with shorter
+ * periods run first, and so do the earlier ones in the script on ties. Give
+ * up once it goes beyond @limit
+ */
+static unsigned long long __rm_response_time(struct rt_task *task, unsigned int limit)
+{
+	unsigned long long response = task->wcet;
+
+	while (true) {
+		unsigned long long next = task->wcet;
+
+		for (struct rt_task *hp = rt_tasks; hp < rt_tasks + nr_rt_tasks; hp++) {
+			if (hp->period > task->period || (hp->period == task->period && hp >= task)) {
+				continue;
+			}
+			/* Jobs of @hp released while @task is responding */
+			next += (response + hp->period - 1) / hp->period * hp->wcet;
+		}
+		if (next == response || next > limit) return next;
+		response = next;
+	}
+}
+
+static void __report_schedulability(void)
+{
+	double utilization = 0, density = 0, bound;
+	bool implicit = true;	/* No job is due before the next release */
+	struct rt_task *task;
+
+	if (!nr_rt_tasks) return;
+
+	for (task = rt_tasks; task < rt_tasks + nr_rt_tasks; task++) {
+		utilization += (double)task->wcet / task->period;
+		if (task->deadline < task->period) {
+			density += (double)task->wcet / task->deadline;
+			implicit = false;
+		} else {
+			density += (double)task->wcet / task->period;
+		}
+	}
+	/* Utilization bound of Liu and Layland */
+	bound = nr_rt_tasks * (pow(2, 1.0 / nr_rt_tasks) - 1);
+
+	printf("\n");
+	printf("Schedulability of %u periodic task%s\n", nr_rt_tasks, nr_rt_tasks >= 2 ? "s" : "");
+	printf("  Utilization: %.3f\n", utilization);
+
+	if (utilization > 1) {
+		printf("  EDF: Not schedulable (utilization > 1)\n");
+	} else if (implicit) {
+		printf("  EDF: Schedulable (utilization <= 1)\n");
+	} else if (density <= 1) {
+		printf("  EDF: Schedulable (density %.3f <= 1)\n", density);
+	} else {
+		printf("  EDF: Not guaranteed (density %.3f > 1)\n", density);
+	}
+
+	if (implicit && utilization <= bound) {
+		printf("  RM:  Schedulable (utilization <= %.3f)\n", bound);
+		return;
+	}
+	for (task = rt_tasks; task < rt_tasks + nr_rt_tasks; task++) {
+		unsigned int deadline = task->deadline < task->period ? task->deadline : task->period;
+
+		if (__rm_response_time(task, deadline) > deadline) {
+			printf("  RM:  Not guaranteed (process %u may respond after %u ticks)\n",
+					task->pid, deadline);
+			return;
+		}
+	}
+	printf("  RM:  Schedulable (response time analysis)\n");
+}
+
+static void __report_deadlines(void)
+{
+	struct lateness_summary summary;
+
+	printf("\n");
+	printf("Deadlines\n");
+	if (__summarize_lateness(&summary)) {
+		printf("  Missed: %u of %u processes (%.2f%%)\n",
+				sim->__nr_missed, sim->__nr_deadlines,
+				(double)sim->__nr_missed * 100 / sim->__nr_deadlines);
+		printf("  Lateness: avg %.2f, p50 %d, p99 %d, max %d\n",
+				summary.avg, summary.p50, summary.p99, summary.max);
+	}
+	__report_schedulability();
+}
+
+
+static void __do_simulation(void)
+{
+	assert(sim->sched->schedule && "scheduler.schedule() not implemented");
+
+	while (true) {
+		bool busy = false;
+
+		/* Fork processes on schedule */
+		__fork_on_schedule();
+
+		/* Each CPU picks the next process to run */
+		for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+			__switch_cpu(cpu);
+			__schedule_cpu();
+
+			if (current || !list_empty(&readyqueue)) busy = true;
+		}
+
+		/* No CPU has a process to run at this moment */
+		if (!busy) {
+			/* Quit simulation if no pending process exists */
+			if (list_empty(&sim->__forkqueue)) {
+				break;
+			}
+
+			/**
+			 * Nothing can happen until the next fork if no one is ready.
+			 * Jump to it in the event-driven mode.
+			 */
+			if (event_driven) {
+				unsigned int next_fork =
+					list_first_entry(&sim->__forkqueue, struct process, list)->__starts_at;
+
+				if (next_fork > ticks + 1) {
+					__print_event(EVENT_IDLE_SPAN, 0, next_fork - ticks);
+					ticks = next_fork;
+					continue;
+				}
+			}
+		}
+
+		if (nr_cpus > 1) __balance_cpus();
+
+		for (unsigned int cpu = 0; cpu < nr_cpus; cpu++) {
+			__switch_cpu(cpu);
+			__run_cpu();
+		}
+
+		/* Increase the tick counter */
+		ticks++;
+	}
+}
+
+
+/**
+ * Make @s the simulation of this thread, and set it up to simulate @sched
+ */
+static void __init_simulation(struct simulation *s, struct scheduler *sched)
+{
+	memset(s, 0, sizeof(*s));
+	sim = s;
+
+	sim->sched = sched;
+
+	INIT_LIST_HEAD(&readyqueue);
+
+	for (int i = 0; i < MAX_NR_CPUS; i++) {
+		INIT_LIST_HEAD(&sim->__cpus[i].rq);
+	}
+
+	for (int i = 0; i < NR_RESOURCES; i++) {
 		resources[i].owner = NULL;
 		INIT_LIST_HEAD(&(resources[i].waitqueue));
 	}
 
-	INIT_LIST_HEAD(&__forkqueue);
+	INIT_LIST_HEAD(&sim->__forkqueue);
+
+	sim->__balance_seed = BALANCE_SEED;
+	sim->__imbalance_window = 1;
+}
+
+static void __initialize(void)
+{
+	__init_simulation(&main_sim, sched);
 
 	if (quiet) return;
 	printf("               _              _ \n");
@@ -410,7 +1481,13 @@ static void __initialize(void)
 	printf("     |___/\\___|_| |_|\\___|\\__,_|\n");
 	printf("\n");
 	printf("                                 2021 Spring\n");
-	printf("      Simulating %s scheduler\n", sched->name);
+	if (all_schedulers) {
+		printf("      Simulating all schedulers\n");
+	} else {
+		printf("      Simulating %s scheduler\n", sim->sched->name);
+	}
+	if (nr_cpus > 1) printf("      on %u CPUs, balanced by %s\n",
+			nr_cpus, __balance_policy_sz[balance_policy]);
 	printf("\n");
 	printf("****************************************************\n");
 	printf("   N: Forked\n");
@@ -418,15 +1495,199 @@ static void __initialize(void)
 	printf("   =: Blocked\n");
 	printf("  +n: Acquire resource n\n");
 	printf("  -n: Release resource n\n");
+	if (nr_cpus > 1) printf("  <n: Migrated from CPU n\n");
+	printf("\n");
+}
+
+
+static int __simulate(void)
+{
+	if (sim->sched->initialize && sim->sched->initialize()) {
+		return -1;
+	}
+
+	__do_simulation();
+
+	if (sim->sched->finalize) {
+		sim->sched->finalize();
+	}
+	return 0;
+}
+
+
+/***********************************************************************
+ * Simulate all the schedulers at once (-A)
+ *
+ * The script is loaded into @main_sim once, and each scheduler simulates
+ * a clone of the workload in its own simulation. The simulations are run
+ * by a pool of threads as many as the online CPUs; each thread takes the
+ * next simulation not taken yet until all are taken. The events are not
+ * printed out, and the summaries of the simulations are compared at last.
+ */
+static struct scheduler *schedulers[] = {
+	&fifo_scheduler,
+	&sjf_scheduler,
+	&srtf_scheduler,
+	&rr_scheduler,
+	&prio_scheduler,
+	&pa_scheduler,
+	&pcp_scheduler,
+	&pip_scheduler,
+	&cfs_scheduler,
+	&edf_scheduler,
+	&rm_scheduler,
+	&mlfq_scheduler,
+};
+
+#define NR_SCHEDULERS	(sizeof(schedulers) / sizeof(*schedulers))
+
+static struct simulation *simulations[NR_SCHEDULERS];
+static int simulation_results[NR_SCHEDULERS];
+static unsigned int next_simulation = 0;
+static pthread_mutex_t simulation_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *__simulation_worker(void *arg)
+{
+	unsigned int i;
+
+	while (true) {
+		pthread_mutex_lock(&simulation_lock);
+		i = next_simulation++;
+		pthread_mutex_unlock(&simulation_lock);
+
+		if (i >= NR_SCHEDULERS) break;
+
+		sim = simulations[i];
+		simulation_results[i] = __simulate();
+	}
+	return NULL;
+}
+
+static void __report_all(void)
+{
+	printf("\n");
+	printf("%-30s %8s %7s %9s", "scheduler", "ticks", "util", "switches");
+	for (int metric = METRIC_TURNAROUND; metric <= METRIC_WAITING; metric++) {
+		printf(" %16s", __metric_sz[metric]);
+	}
+	if (nr_cpus > 1 && balance_policy != BALANCE_NONE) printf(" %11s %10s", "migrations", "imbalance");
+	if (nr_deadline_jobs) printf(" %7s %9s", "missed", "lateness");
+	printf("\n");
+
+	printf("%-30s %8s %7s %9s", "", "", "", "");
+	for (int metric = METRIC_TURNAROUND; metric <= METRIC_WAITING; metric++) {
+		printf(" %10s %5s", "avg", "p99");
+	}
+	if (nr_cpus > 1 && balance_policy != BALANCE_NONE) printf(" %11s %10s", "", "");
+	if (nr_deadline_jobs) printf(" %7s %9s", "", "p99");
 	printf("\n");
+
+	for (int i = 0; i < NR_SCHEDULERS; i++) {
+		struct metric_summary summaries[NR_METRICS];
+
+		sim = simulations[i];
+
+		if (simulation_results[i] || !__summarize_metrics(summaries)) {
+			printf("%-30s failed\n", sim->sched->name);
+			continue;
+		}
+		printf("%-30s %8u %6.1f%% %9llu", sim->sched->name, ticks,
+				__utilization(), sim->__nr_switches);
+		for (int metric = METRIC_TURNAROUND; metric <= METRIC_WAITING; metric++) {
+			printf(" %10.2f %5u", summaries[metric].avg, summaries[metric].p99);
+		}
+		if (nr_cpus > 1 && balance_policy != BALANCE_NONE) printf(" %11llu %10.2f",
+				sim->__nr_migrations, __average_imbalance());
+		if (nr_deadline_jobs) {
+			struct lateness_summary lateness;
+
+			if (__summarize_lateness(&lateness)) {
+				printf(" %7u %9d", sim->__nr_missed, lateness.p99);
+			}
+		}
+		printf("\n");
+	}
+	sim = &main_sim;
+
+	__report_schedulability();
+}
+
+static int __simulate_all(void)
+{
+	pthread_t threads[NR_SCHEDULERS];
+	long nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	struct process *p, *tmp;
+	int ret = 0;
+
+	if (nr_threads < 1) nr_threads = 1;
+	if (nr_threads > NR_SCHEDULERS) nr_threads = NR_SCHEDULERS;
+
+	for (int i = 0; i < NR_SCHEDULERS; i++) {
+		simulations[i] = malloc(sizeof(struct simulation));
+		__init_simulation(simulations[i], schedulers[i]);
+
+		list_for_each_entry(p, &main_sim.__forkqueue, list) {
+			list_add_tail(&__clone_process(p)->list, &simulations[i]->__forkqueue);
+		}
+	}
+	sim = &main_sim;
+
+	for (int i = 0; i < nr_threads; i++) {
+		if (pthread_create(threads + i, NULL, __simulation_worker, NULL)) {
+			nr_threads = i;
+			break;
+		}
+	}
+	/* Do it on our own if no thread is there to do */
+	if (!nr_threads) __simulation_worker(NULL);
+
+	for (int i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	__report_all();
+
+	for (int i = 0; i < NR_SCHEDULERS; i++) {
+		if (simulation_results[i]) ret = -1;
+		free(simulations[i]->__metrics);
+		free(simulations[i]->__lateness);
+		free(simulations[i]);
+	}
+	list_for_each_entry_safe(p, tmp, &main_sim.__forkqueue, list) {
+		list_del(&p->list);
+		__free_process(p);
+	}
+	return ret;
 }
 
+/* Parse the comma-separated quanta of the MLFQ levels from the top */
+static int __parse_quanta(char *quanta)
+{
+	char *quantum;
+
+	nr_mlfq_quanta = 0;
+	while ((quantum = strsep(&quanta, ",")) != NULL) {
+		if (nr_mlfq_quanta == MAX_PRIO || atoi(quantum) < 1) return -1;
+		mlfq_quanta[nr_mlfq_quanta++] = atoi(quantum);
+	}
+	return 0;
+}
 
 static void __print_usage(char * const name)
 {
-	printf("Usage: %s {-q} -[f|s|S|r|a|p|i] [process script file]\n", name);
+	printf("Usage: %s {-q} {-e} {-m} {-l log} {-n cpus} {-b policy} {-M} {-L latency} {-G granularity}\n           {-N levels} {-T quanta} {-B boost} -[A|f|s|S|r|a|p|i|F|E|R|Q] [process script file]\n", name);
 	printf("\n");
-	printf("  -q: Run quietly\n\n");
+	printf("  -q: Run quietly\n");
+	printf("  -e: Jump over idle stretches to the next fork\n");
+	printf("  -m: Stream the script in. Processes should be in the order of fork\n");
+	printf("      ticks\n");
+	printf("  -l: Write the events to @log in binary. Decode it with evdecode\n");
+	printf("  -n: Number of CPUs to simulate, up to %d (default: 1)\n", MAX_NR_CPUS);
+	printf("  -b: Balance the load of the CPUs (default: none);\n");
+	printf("      random|busiest|near to steal from the victim chosen so when idle,\n");
+	printf("      push to push from the busiest to the idlest every %d ticks\n", PUSH_PERIOD);
+	printf("  -M: Print the turnaround, response, waiting, and blocked times of the\n");
+	printf("      processes, the throughput, and the CPU utilization at the end\n\n");
 	printf("  -f: Use FIFO scheduler (default)\n");
 	printf("  -s: Use SJF scheduler\n");
 	printf("  -S: Use SRTF scheduler\n");
@@ -435,6 +1696,17 @@ static void __print_usage(char * const name)
 	printf("  -a: Use Priority scheduler with aging\n");
 	printf("  -c: Use Priority scheduler with PCP\n");
 	printf("  -i: Use Priority scheduler with PIP\n");
+	printf("  -F: Use CFS scheduler. Share -L ticks (default: %u) among the ready\n", cfs_latency);
+	printf("      processes by their priorities, but run each for -G ticks\n");
+	printf("      (default: %u) at least\n", cfs_min_granularity);
+	printf("  -E: Use EDF scheduler\n");
+	printf("  -R: Use Rate-monotonic scheduler\n");
+	printf("  -Q: Use MLFQ scheduler with -N levels (default: %u). Give the quanta\n", mlfq_levels);
+	printf("      of the levels from the top with -T q0,q1,... (default: %u, and\n", mlfq_quanta[0]);
+	printf("      twice the one above for the rest), and boost all to the top\n");
+	printf("      every -B ticks (default: %u, 0 not to boost)\n", mlfq_boost_period);
+	printf("  -A: Simulate all the schedulers in parallel and compare them.\n");
+	printf("      Cannot be used with -m and -l\n");
 	printf("\n");
 }
 
@@ -444,12 +1716,73 @@ int main(int argc, char * const argv[])
 	int opt;
 	char *scriptfile;
 
-	while ((opt = getopt(argc, argv, "qfsSrpaich")) != -1) {
+	while ((opt = getopt(argc, argv, "qeml:n:b:ML:G:N:T:B:AfsSrpaicFERQh")) != -1) {
 		switch (opt) {
 		case 'q':
 			quiet = true;
 			break;
+		case 'e':
+			event_driven = true;
+			break;
+		case 'm':
+			stream_script = true;
+			break;
+		case 'l':
+			event_log = optarg;
+			break;
+		case 'n':
+			nr_cpus = atoi(optarg);
+			if (nr_cpus < 1 || nr_cpus > MAX_NR_CPUS) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			for (balance_policy = 0; balance_policy < NR_BALANCE_POLICIES; balance_policy++) {
+				if (strcmp(optarg, __balance_policy_sz[balance_policy]) == 0) break;
+			}
+			if (balance_policy == NR_BALANCE_POLICIES) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
 
+		case 'M':
+			print_metrics = true;
+			break;
+		case 'L':
+			cfs_latency = atoi(optarg);
+			if (cfs_latency < 1) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'G':
+			cfs_min_granularity = atoi(optarg);
+			if (cfs_min_granularity < 1) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'N':
+			mlfq_levels = atoi(optarg);
+			if (mlfq_levels < 1 || mlfq_levels > MAX_PRIO) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'T':
+			if (__parse_quanta(optarg)) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'B':
+			mlfq_boost_period = atoi(optarg);
+			break;
+		case 'A':
+			all_schedulers = true;
+			break;
 		case 'f':
 			sched = &fifo_scheduler;
 			break;
@@ -474,6 +1807,18 @@ int main(int argc, char * const argv[])
 		case 'c':
 			sched = &pcp_scheduler;
 			break;
+		case 'F':
+			sched = &cfs_scheduler;
+			break;
+		case 'E':
+			sched = &edf_scheduler;
+			break;
+		case 'R':
+			sched = &rm_scheduler;
+			break;
+		case 'Q':
+			sched = &mlfq_scheduler;
+			break;
 		case 'h':
 		default:
 			__print_usage(argv[0]);
@@ -481,11 +1826,17 @@ int main(int argc, char * const argv[])
 		}
 	}
 
-	if (optind >= argc) {
+	/* The simulations of -A share the loaded script and print no event */
+	if (optind >= argc || (all_schedulers && (stream_script || event_log))) {
 		__print_usage(argv[0]);
 		return EXIT_FAILURE;
 	}
 
+	for (int i = nr_mlfq_quanta; i < MAX_PRIO; i++) {
+		mlfq_quanta[i] = mlfq_quanta[i - 1] <= UINT_MAX / 2 ?
+				mlfq_quanta[i - 1] * 2 : mlfq_quanta[i - 1];
+	}
+
 	scriptfile = argv[optind];
 
 	__initialize();
@@ -494,16 +1845,29 @@ int main(int argc, char * const argv[])
 		return EXIT_FAILURE;
 	}
 
-	if (sched->initialize && sched->initialize()) {
-		return EXIT_FAILURE;
+	if (all_schedulers) {
+		return __simulate_all() ? EXIT_FAILURE : EXIT_SUCCESS;
 	}
 
-	__do_simulation();
+	if (event_log && open_event_log(event_log, nr_cpus)) {
+		fprintf(stderr, "Unable to open %s\n", event_log);
+		return EXIT_FAILURE;
+	}
 
-	if (sched->finalize) {
-		sched->finalize();
+	if (__simulate()) {
+		return EXIT_FAILURE;
 	}
 
+	close_event_log();
+
+	if (nr_cpus > 1) __report_balance();
+
+	if (print_metrics) __report_metrics();
+	free(sim->__metrics);
+
+	if (nr_deadline_jobs) __report_deadlines();
+	free(sim->__lateness);
+
 	return EXIT_SUCCESS;
 }
 /*          ******        DO NOT MODIFY THIS FILE        ******       */
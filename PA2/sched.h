@@ -73,6 +73,34 @@ struct scheduler {
 	void (*exiting)(struct process *);
 
 
+	/***********************************************************************
+	 * void migrating(struct process *process)
+	 * void migrated(struct process *process)
+	 *
+	 * DESCRIPTION
+	 *   Called when the framework moves the ready @process to another CPU
+	 *   to balance the load. migrating() is called on the CPU @process
+	 *   leaves, before it is taken off from @readyqueue. migrated() is
+	 *   called on the new CPU after @process is put at the tail of
+	 *   @readyqueue. Update your own per-CPU structures, if any, in them.
+	 *   Leave them NULL if @readyqueue is all you keep.
+	 */
+	void (*migrating)(struct process *);
+	void (*migrated)(struct process *);
+
+
+	/***********************************************************************
+	 * unsigned int nr_ready(unsigned int cpu)
+	 *
+	 * DESCRIPTION
+	 *   Tell how many processes are in the ready queue of @cpu. The framework
+	 *   asks it every tick to balance the load with -b, so keep the count as
+	 *   processes come and go instead of walking the queue. The load is
+	 *   not balanced if it is left NULL.
+	 */
+	unsigned int (*nr_ready)(unsigned int cpu);
+
+
 	/***********************************************************************
 	 * struct process *schedule(void)
 	 *
@@ -91,6 +119,23 @@ struct scheduler {
 	struct process *(*schedule)(void);
 
 
+	/***********************************************************************
+	 * unsigned int next_decision(void)
+	 *
+	 * DESCRIPTION
+	 *   Tell how many more ticks @current keeps running for sure if nothing
+	 *   but its aging happens, that is, until the scheduler needs to make
+	 *   the next decision. The framework then runs @current over the ticks
+	 *   in one step without calling schedule(). It still stops at the next
+	 *   fork and at the next resource acquisition or release of @current.
+	 *   Leave it NULL to be asked by schedule() every tick.
+	 *
+	 * RETURN
+	 *   Number of ticks @current runs on after the current tick
+	 */
+	unsigned int (*next_decision)(void);
+
+
 	/***********************************************************************
 	 * bool acquire(int resource_id)
 	 *
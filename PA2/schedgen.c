@@ -0,0 +1,246 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/**
+ * Synthetic workload generator for the simulator. It writes a process
+ * script with Poisson or bursty arrivals, heavy-tailed (Pareto) lifespans,
+ * a priority distribution, and random resource acquisitions to stdout.
+ * The same seed and options always give the same script.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "process.h"
+#include "resource.h"
+
+#define MAX_ACQUIRES	8	/* Resource acquisitions per process at most */
+
+enum arrival { ARRIVAL_POISSON, ARRIVAL_BURSTY };
+enum prio_dist { PRIO_UNIFORM, PRIO_BIMODAL, PRIO_FIXED };
+
+static int nr_processes = 100;
+static uint64_t seed = 0x5eed;
+static enum arrival arrival = ARRIVAL_POISSON;
+static double mean_interval = 4.0;		/* Mean ticks between arrivals */
+static double mean_burst = 8.0;			/* Mean processes in a burst */
+static double alpha = 1.5;				/* Shape of the lifespan distribution */
+static int min_lifespan = 1;
+static int max_lifespan = 1000;
+static enum prio_dist prio_dist = PRIO_UNIFORM;
+static int fixed_prio = 0;
+static double acquire_ratio = 0.3;		/* Processes acquiring resources */
+static int max_acquires = 3;
+
+/**
+ * splitmix64. Not the best generator, but small, fast, and gives the same
+ * sequence everywhere
+ */
+static uint64_t __next_random(void)
+{
+	uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Uniform in (0, 1) */
+static double __uniform(void)
+{
+	return ((__next_random() >> 11) + 0.5) / (double)(1ULL << 53);
+}
+
+/* Uniform in [lo, hi] */
+static int __uniform_int(int lo, int hi)
+{
+	return lo + (int)(__next_random() % (uint64_t)(hi - lo + 1));
+}
+
+static double __exponential(double mean)
+{
+	return -mean * log(__uniform());
+}
+
+static int __pareto(void)
+{
+	double x = min_lifespan / pow(__uniform(), 1.0 / alpha);
+
+	return x >= max_lifespan ? max_lifespan : (int)x;
+}
+
+static int __priority(void)
+{
+	switch (prio_dist) {
+	case PRIO_BIMODAL:
+		/* Mostly background ones with a few interactive ones */
+		if (__uniform() < 0.8) return __uniform_int(0, MAX_PRIO / 4);
+		return __uniform_int(MAX_PRIO * 3 / 4, MAX_PRIO);
+	case PRIO_FIXED:
+		return fixed_prio;
+	case PRIO_UNIFORM:
+	default:
+		return __uniform_int(0, MAX_PRIO);
+	}
+}
+
+/**
+ * Acquire resources one after another so that a process never holds two
+ * resources at the same time, and thus processes cannot deadlock.
+ */
+static void __generate_acquires(int lifespan)
+{
+	int nr_acquires, at = 0;
+
+	if (__uniform() >= acquire_ratio) return;
+
+	nr_acquires = __uniform_int(1, max_acquires);
+	for (int i = 0; i < nr_acquires && at < lifespan; i++) {
+		int resource_id = __uniform_int(0, NR_RESOURCES - 1);
+		int duration;
+
+		at = __uniform_int(at, lifespan - 1);
+		duration = __uniform_int(1, lifespan - at);
+
+		printf("\tacquire %d %d %d\n", resource_id, at, duration);
+		at += duration;
+	}
+}
+
+static void __generate(void)
+{
+	double now = 0.0;
+	int in_burst = 0;
+
+	for (int pid = 1; pid <= nr_processes; pid++) {
+		int lifespan = __pareto();
+
+		if (arrival == ARRIVAL_BURSTY) {
+			/* Bursts arrive in Poisson, and the members come back to back */
+			if (in_burst == 0) {
+				now += __exponential(mean_interval * mean_burst);
+				in_burst = 1 + (int)__exponential(mean_burst - 1.0);
+			}
+			in_burst--;
+		} else if (pid > 1) {
+			now += __exponential(mean_interval);
+		}
+
+		printf("process %d\n", pid);
+		printf("\tstart %u\n", (unsigned int)now);
+		printf("\tprio %d\n", __priority());
+		printf("\tlifespan %d\n", lifespan);
+		__generate_acquires(lifespan);
+		printf("end\n\n");
+	}
+}
+
+static void __print_usage(char * const name)
+{
+	fprintf(stderr, "Usage: %s {-n processes} {-s seed} {-a poisson|bursty} {-i interval}\n", name);
+	fprintf(stderr, "         {-b burst} {-l alpha} {-L min:max} {-p uniform|bimodal|N}\n");
+	fprintf(stderr, "         {-r ratio} {-R acquires}\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -n: Number of processes (default: %d)\n", nr_processes);
+	fprintf(stderr, "  -s: Seed for the random numbers\n");
+	fprintf(stderr, "  -a: Arrival pattern (default: poisson)\n");
+	fprintf(stderr, "  -i: Mean ticks between arrivals (default: %.1f)\n", mean_interval);
+	fprintf(stderr, "  -b: Mean processes in a burst for bursty arrivals (default: %.1f)\n", mean_burst);
+	fprintf(stderr, "  -l: Shape of the Pareto lifespans. Smaller is heavier (default: %.1f)\n", alpha);
+	fprintf(stderr, "  -L: Range of the lifespans (default: %d:%d)\n", min_lifespan, max_lifespan);
+	fprintf(stderr, "  -p: Priority distribution, or a fixed priority (default: uniform)\n");
+	fprintf(stderr, "  -r: Ratio of processes acquiring resources (default: %.1f)\n", acquire_ratio);
+	fprintf(stderr, "  -R: Resource acquisitions per process at most (default: %d)\n", max_acquires);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char * const argv[])
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:a:i:b:l:L:p:r:R:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_processes = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'a':
+			if (strcmp(optarg, "poisson") == 0) {
+				arrival = ARRIVAL_POISSON;
+			} else if (strcmp(optarg, "bursty") == 0) {
+				arrival = ARRIVAL_BURSTY;
+			} else {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'i':
+			mean_interval = atof(optarg);
+			break;
+		case 'b':
+			mean_burst = atof(optarg);
+			break;
+		case 'l':
+			alpha = atof(optarg);
+			break;
+		case 'L':
+			if (sscanf(optarg, "%d:%d", &min_lifespan, &max_lifespan) != 2) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'p':
+			if (strcmp(optarg, "uniform") == 0) {
+				prio_dist = PRIO_UNIFORM;
+			} else if (strcmp(optarg, "bimodal") == 0) {
+				prio_dist = PRIO_BIMODAL;
+			} else {
+				prio_dist = PRIO_FIXED;
+				fixed_prio = atoi(optarg);
+			}
+			break;
+		case 'r':
+			acquire_ratio = atof(optarg);
+			break;
+		case 'R':
+			max_acquires = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (nr_processes < 1 || mean_interval < 0 || mean_burst < 1 || alpha <= 0 ||
+			min_lifespan < 1 || max_lifespan < min_lifespan ||
+			fixed_prio < 0 || fixed_prio > MAX_PRIO ||
+			max_acquires < 1 || max_acquires > MAX_ACQUIRES) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	__generate();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+/**********************************************************************
+ * Copyright (c) 2019-2021
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include "list_head.h"
+#include "process.h"
+#include "resource.h"
+
+struct scheduler;
+
+/**
+ * A CPU that is not being looked into at the moment. See @this_cpu below
+ */
+struct cpu {
+	struct process *curr;
+	struct list_head rq;
+};
+
+#define NR_IMBALANCE_WINDOWS	32	/* See __account_imbalance() in sched.c */
+
+struct imbalance_window {
+	unsigned long long imbalance;
+	unsigned int nr_ticks;
+};
+
+enum metric {
+	METRIC_TURNAROUND,	/* From the fork to the exit */
+	METRIC_RESPONSE,	/* From the fork to the first run */
+	METRIC_WAITING,		/* Ready but not running */
+	METRIC_BLOCKED,		/* Waiting for resources */
+	NR_METRICS,
+};
+
+struct process_metrics {
+	unsigned int values[NR_METRICS];	/* In ticks */
+};
+
+/***********************************************************************
+ * struct simulation
+ *
+ * DESCRIPTION
+ *   The state of a workload being simulated with a scheduler. A thread
+ *   simulates one workload at a time, which @sim points to. Schedulers may
+ *   use the following as if they were globals;
+ *
+ *    current      The process that is currently running
+ *    readyqueue   List head to hold the processes ready to run
+ *    this_cpu     The CPU being simulated at the moment. @current and
+ *                 @readyqueue are the ones of this CPU
+ *    resources    Resources in the system
+ *    ticks        Monotonically increasing ticks
+ */
+struct simulation {
+	struct scheduler *sched;	/* Scheduler being simulated */
+
+	struct process *current;
+	struct list_head readyqueue;
+	unsigned int this_cpu;
+	struct resource resources[NR_RESOURCES];
+	unsigned int ticks;
+
+	/** DO NOT ACCESS FOLLOWING VARIABLES **/
+	struct list_head __forkqueue;	/* Sorted by __starts_at once loaded */
+	struct cpu __cpus[MAX_NR_CPUS];	/* Other CPUs keep theirs here */
+	unsigned int __fork_cpu;		/* CPU to fork the next process on */
+
+	/* Load balancing */
+	unsigned int __balance_seed;
+	unsigned long long __nr_migrations;
+	struct imbalance_window __imbalances[NR_IMBALANCE_WINDOWS];
+	unsigned int __imbalance_window;		/* Ticks per window */
+	unsigned int __max_imbalance;
+
+	/* Metrics of the exited processes */
+	struct process_metrics *__metrics;
+	unsigned int __nr_exited;
+	unsigned int __metrics_size;
+	unsigned long long __busy_ticks;	/* Sum of the lifespans */
+	unsigned long long __nr_switches;	/* Context switches */
+
+	/* Lateness of the exited processes with a deadline */
+	int *__lateness;				/* Exit tick - deadline */
+	unsigned int __nr_deadlines;
+	unsigned int __lateness_size;
+	unsigned int __nr_missed;
+};
+
+extern __thread struct simulation *sim;
+
+#define current		(sim->current)
+#define readyqueue	(sim->readyqueue)
+#define this_cpu	(sim->this_cpu)
+#define resources	(sim->resources)
+#define ticks		(sim->ticks)
+
+#endif